@@ -0,0 +1,197 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measurement helpers shared by the benchmarks: a global operator new that
+// counts the heap allocations of the whole program, a hardware cache-miss
+// counter, and the timing loops that report the time, the allocations and the
+// cache misses per call. The operator new is defined here, so this header is
+// included by a single translation unit of each benchmark program.
+
+#ifndef TARA_BENCH_COMMON_H
+#define TARA_BENCH_COMMON_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Heap allocations of the whole program, and their bytes, counted by the global operator new
+static std::atomic<uint64_t> g_allocations(0);
+static std::atomic<uint64_t> g_allocatedBytes(0);
+
+void*
+operator new(std::size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+  return p;
+}
+
+void
+operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+// Hardware cache-miss counter of the calling thread, if the kernel allows it
+class CacheMissCounter
+{
+public:
+  CacheMissCounter()
+    : m_fd(-1)
+  {
+#ifdef __linux__
+    struct perf_event_attr attr = {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~CacheMissCounter()
+  {
+#ifdef __linux__
+    if (m_fd >= 0)
+      {
+        close(m_fd);
+      }
+#endif
+  }
+
+  bool IsAvailable() const
+  {
+    return m_fd >= 0;
+  }
+
+  void Start()
+  {
+#ifdef __linux__
+    if (m_fd >= 0)
+      {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+  }
+
+  uint64_t Stop()
+  {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (m_fd >= 0)
+      {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+          {
+            count = 0;
+          }
+      }
+#endif
+    return count;
+  }
+
+private:
+  int m_fd;
+};
+
+// Time, heap allocations and cache misses per call of nCalls calls; returns the time (ns)
+inline double
+Measure(const std::string& name, uint32_t nCalls, CacheMissCounter& misses,
+        const std::function<void(uint32_t)>& call)
+{
+  uint64_t allocations = g_allocations.load();
+  misses.Start();
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nCalls; i++)
+    {
+      call(i);
+    }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  uint64_t missCount = misses.Stop();
+  allocations = g_allocations.load() - allocations;
+
+  std::cout << std::left << std::setw(38) << name << std::right << std::setw(10)
+            << std::chrono::duration<double, std::nano>(elapsed).count() / nCalls << " ns/call"
+            << std::setw(10) << static_cast<double>(allocations) / nCalls << " allocs/call";
+  if (misses.IsAvailable())
+    {
+      std::cout << std::setw(10) << static_cast<double>(missCount) / nCalls << " misses/call";
+    }
+  std::cout << std::endl;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / nCalls;
+}
+
+// Same as Measure, for a call that needs a setup, which is not measured, and
+// reported per unit of work when a call covers several (e.g. stations)
+inline double
+MeasureEach(const std::string& name, uint32_t nCalls, CacheMissCounter& misses,
+            const std::function<void(uint32_t)>& setup,
+            const std::function<void(uint32_t)>& call, uint32_t unitsPerCall = 1)
+{
+  std::chrono::steady_clock::duration elapsed(0);
+  uint64_t allocations = 0;
+  uint64_t missCount = 0;
+  for (uint32_t i = 0; i < nCalls; i++)
+    {
+      setup(i);
+      uint64_t callAllocations = g_allocations.load();
+      misses.Start();
+      auto start = std::chrono::steady_clock::now();
+      call(i);
+      elapsed += std::chrono::steady_clock::now() - start;
+      missCount += misses.Stop();
+      allocations += g_allocations.load() - callAllocations;
+    }
+  nCalls *= unitsPerCall;
+
+  std::cout << std::left << std::setw(38) << name << std::right << std::setw(10)
+            << std::chrono::duration<double, std::nano>(elapsed).count() / nCalls << " ns/call"
+            << std::setw(10) << static_cast<double>(allocations) / nCalls << " allocs/call";
+  if (misses.IsAvailable())
+    {
+      std::cout << std::setw(10) << static_cast<double>(missCount) / nCalls << " misses/call";
+    }
+  std::cout << std::endl;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / nCalls;
+}
+
+#endif /* TARA_BENCH_COMMON_H */
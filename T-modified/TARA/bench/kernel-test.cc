@@ -0,0 +1,482 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Equivalence test of the statistics update kernels of the TARAWifiManager:
+// the SSE2 and AVX2 kernels compiled in (kernel-test is built with the default
+// flags of the target, kernel-test-avx2 with -mavx2 on x86-64) are compared
+// with the scalar reference on the same tables:
+// - every lane combination of 8 consecutive rates (not supported, supported and
+//   not attempted, first success, EWMA update), on the whole block and on every
+//   tail of it;
+// - randomized tables, for every range [begin, end) with begin a multiple of
+//   the SIMD width and end - begin from 0 to 67, i.e. with tails that are not
+//   a multiple of 4 or 8.
+// The success probabilities must be identical, the EWMA, EWMSD and throughput
+// within the relative error TARA_KERNEL_TOLERANCE, and the entries the
+// reference leaves unchanged must be left unchanged. The program exits with 1
+// on the first mismatch.
+//
+// With --input, the tables are instead those recorded by a run with the
+// PrintStats attribute set (minstrel-ht-stats-<address>.bin): the state of
+// every table before its update is rebuilt from the previous table of the
+// station and the counters of the last interval, the kernels are compared on
+// it, and the reference must also reproduce the recorded probabilities (with
+// --ewmaLevel set to the EWMA attribute of the run).
+
+#include <ns3/core-module.h>
+#include <ns3/tara-rate-stats-kernel.h>
+#include <ns3/tara-wifi-manager.h>
+
+#include "../tools/tara-decode.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+typedef void (*Kernel)(const TARARateStats&, const double*, std::size_t, std::size_t, double);
+
+// A kernel under test, and the number of rates of its steps
+struct Candidate
+{
+  std::string name;
+  Kernel kernel;
+  std::size_t width;
+};
+
+// Statistics tables of a station, with the layout of the station pool
+class Tables
+{
+public:
+  explicit Tables(std::size_t nRates)
+    : m_nRates(nRates),
+      m_doubles(6 * nRates),
+      m_hist(2 * nRates),
+      m_counters(3 * nRates),
+      m_dirty((nRates + 63) / 64)
+  {
+    m_stats.prob = m_doubles.data();
+    m_stats.ewmaProb = m_stats.prob + nRates;
+    m_stats.ewmsdProb = m_stats.ewmaProb + nRates;
+    m_stats.throughput = m_stats.ewmsdProb + nRates;
+    m_stats.txTime = m_stats.throughput + nRates;
+    m_stats.successHist = m_hist.data();
+    m_stats.attemptHist = m_stats.successHist + nRates;
+    m_stats.numRateAttempt = m_counters.data();
+    m_stats.numRateSuccess = m_stats.numRateAttempt + nRates;
+    m_stats.supported = m_stats.numRateSuccess + nRates;
+    m_stats.dirty = m_dirty.data();
+  }
+
+  Tables(const Tables& other)
+    : Tables(other.m_nRates)
+  {
+    m_doubles = other.m_doubles;
+    m_hist = other.m_hist;
+    m_counters = other.m_counters;
+    m_dirty = other.m_dirty;
+  }
+
+  Tables& operator=(const Tables&) = delete;
+
+  const TARARateStats& Get() const
+  {
+    return m_stats;
+  }
+
+  std::size_t GetNRates() const
+  {
+    return m_nRates;
+  }
+
+  // Lane states of SetLane
+  enum LaneState
+  {
+    NOT_SUPPORTED = 0,
+    NOT_ATTEMPTED,
+    FIRST_SUCCESS,
+    UPDATE,
+    N_LANE_STATES
+  };
+
+  // Random values for rate i, in the given state
+  void SetLane(std::size_t i, LaneState state, std::mt19937& rng)
+  {
+    std::uniform_int_distribution<uint32_t> attempts(1, 1000);
+    std::uniform_real_distribution<double> percent(0, 100);
+    std::uniform_real_distribution<double> airtime(1e-5, 1e-3);
+
+    m_stats.supported[i] = state == NOT_SUPPORTED ? 0 : ~0U;
+    m_stats.numRateAttempt[i] = state == NOT_ATTEMPTED ? 0 : attempts(rng);
+    m_stats.numRateSuccess[i] =
+        std::uniform_int_distribution<uint32_t>(0, m_stats.numRateAttempt[i])(rng);
+    m_stats.successHist[i] = state == FIRST_SUCCESS ? 0 : 1 + rng() % 100000;
+    m_stats.attemptHist[i] = m_stats.successHist[i] + rng() % 100000;
+    // Values of the previous interval, left as is by the kernels for the lanes not updated
+    m_stats.prob[i] = percent(rng);
+    m_stats.ewmaProb[i] = percent(rng);
+    m_stats.ewmsdProb[i] = percent(rng) / 2;
+    m_stats.throughput[i] = percent(rng) * 1e4;
+    m_stats.txTime[i] = airtime(rng);
+  }
+
+private:
+  std::size_t m_nRates;
+  std::vector<double> m_doubles;
+  std::vector<uint64_t> m_hist;
+  std::vector<uint32_t> m_counters;
+  std::vector<uint64_t> m_dirty;
+  TARARateStats m_stats;
+};
+
+static uint64_t g_comparisons = 0;
+static double g_maxError = 0;
+
+static void
+Fail(const std::string& kernel, const std::string& array, std::size_t i, std::size_t begin,
+     std::size_t end, double expected, double actual)
+{
+  std::cerr.precision(17);
+  std::cerr << "FAIL " << kernel << ": " << array << "[" << i << "] = " << actual
+            << ", expected " << expected << " (range [" << begin << ", " << end << "))"
+            << std::endl;
+  std::exit(1);
+}
+
+static void
+CheckClose(const std::string& kernel, const std::string& array, std::size_t i, std::size_t begin,
+           std::size_t end, double expected, double actual)
+{
+  g_comparisons++;
+  double scale = std::max(std::fabs(expected), std::fabs(actual));
+  double error = scale > 0 ? std::fabs(expected - actual) / scale : 0;
+  g_maxError = std::max(g_maxError, error);
+  if (!(error <= TARA_KERNEL_TOLERANCE))
+    {
+      Fail(kernel, array, i, begin, end, expected, actual);
+    }
+}
+
+static void
+CheckExact(const std::string& kernel, const std::string& array, std::size_t i, std::size_t begin,
+           std::size_t end, double expected, double actual)
+{
+  g_comparisons++;
+  if (std::memcmp(&expected, &actual, sizeof(double)) != 0)
+    {
+      Fail(kernel, array, i, begin, end, expected, actual);
+    }
+}
+
+// Run the reference and a kernel on copies of the tables, on [begin, end), and compare
+static void
+Compare(const std::string& name, Kernel kernel, const Tables& input, std::size_t begin,
+        std::size_t end, double weight)
+{
+  Tables expected(input);
+  Tables actual(input);
+  UpdateRateStatsScalar(expected.Get(), expected.Get().txTime, begin, end, weight);
+  kernel(actual.Get(), actual.Get().txTime, begin, end, weight);
+
+  const TARARateStats& e = expected.Get();
+  const TARARateStats& a = actual.Get();
+  const TARARateStats& in = input.Get();
+  for (std::size_t i = 0; i < input.GetNRates(); i++)
+    {
+      bool updated = i >= begin && i < end && in.supported[i] != 0 && in.numRateAttempt[i] > 0;
+      if (!updated)
+        {
+          // Bit for bit what the reference left, i.e. the input
+          CheckExact(name, "prob", i, begin, end, e.prob[i], a.prob[i]);
+          CheckExact(name, "ewmaProb", i, begin, end, e.ewmaProb[i], a.ewmaProb[i]);
+          CheckExact(name, "ewmsdProb", i, begin, end, e.ewmsdProb[i], a.ewmsdProb[i]);
+          CheckExact(name, "throughput", i, begin, end, e.throughput[i], a.throughput[i]);
+          continue;
+        }
+      CheckExact(name, "prob", i, begin, end, e.prob[i], a.prob[i]);
+      CheckClose(name, "ewmaProb", i, begin, end, e.ewmaProb[i], a.ewmaProb[i]);
+      CheckClose(name, "ewmsdProb", i, begin, end, e.ewmsdProb[i], a.ewmsdProb[i]);
+      CheckClose(name, "throughput", i, begin, end, e.throughput[i], a.throughput[i]);
+    }
+  // The counters are read only
+  for (std::size_t i = 0; i < input.GetNRates(); i++)
+    {
+      if (a.numRateAttempt[i] != in.numRateAttempt[i] ||
+          a.numRateSuccess[i] != in.numRateSuccess[i] || a.supported[i] != in.supported[i] ||
+          a.successHist[i] != in.successHist[i] || a.attemptHist[i] != in.attemptHist[i])
+        {
+          Fail(name, "counters", i, begin, end, 0, 0);
+        }
+    }
+}
+
+static void
+PrintSummary(const std::vector<Candidate>& kernels)
+{
+  std::cout << "kernel-test:";
+  for (const auto& k : kernels)
+    {
+      std::cout << " " << k.name;
+    }
+  std::cout << ": " << g_comparisons << " comparisons, max relative error " << g_maxError
+            << " (tolerance " << TARA_KERNEL_TOLERANCE << "), OK" << std::endl;
+}
+
+// Recorded table of a station, by rate index
+typedef std::map<uint16_t, TARAStatsRecord> RecordedTable;
+
+static uint64_t g_replayedRates = 0;
+static uint64_t g_skippedRates = 0;
+
+// Rebuild the state of a recorded table before its update, from the previous
+// table of the station (nullptr for its first table), and compare the kernels
+// on it, on the whole table and on the blocks of 64 rates of the station pool
+static void
+ReplayTable(const std::vector<Candidate>& kernels, const RecordedTable& table,
+            const RecordedTable* previous, double weight)
+{
+  Tables input(table.rbegin()->first + 1);
+  const TARARateStats& in = input.Get();
+  std::memset(in.supported, 0, input.GetNRates() * sizeof(uint32_t));
+  for (const auto& entry : table)
+    {
+      std::size_t i = entry.first;
+      const TARAStatsRecord& r = entry.second;
+      const TARAStatsRecord* before = nullptr;
+      if (previous != nullptr && previous->count(entry.first) != 0)
+        {
+          before = &previous->at(entry.first);
+        }
+      bool updated = (r.flags & TARA_STATS_LAST_INTERVAL) != 0 && r.attempts > 0;
+      in.supported[i] = ~0U;
+      in.numRateAttempt[i] = updated ? r.attempts : 0;
+      in.numRateSuccess[i] = updated ? r.successes : 0;
+      in.successHist[i] = r.successHist - (updated ? r.successes : 0);
+      in.attemptHist[i] = r.attemptHist - (updated ? r.attempts : 0);
+      if (updated && before == nullptr && in.successHist[i] != 0)
+        {
+          // Updated before the first table of the file: the EWMA it started from is unknown
+          in.numRateAttempt[i] = 0;
+          in.numRateSuccess[i] = 0;
+          g_skippedRates++;
+        }
+      else if (updated)
+        {
+          g_replayedRates++;
+        }
+      const TARAStatsRecord& state = before != nullptr ? *before : r;
+      in.prob[i] = state.prob;
+      in.ewmaProb[i] = state.ewmaProb;
+      in.ewmsdProb[i] = state.ewmsdProb;
+      in.throughput[i] = state.throughput;
+      // The airtime the manager divided by, or that of the first MPDU if the throughput is 0
+      in.txTime[i] = r.throughput > 0 ? std::min(r.ewmaProb, 90.0) / r.throughput
+                                      : std::max<uint32_t>(r.airtime, 1) * 1e-6;
+    }
+
+  for (const auto& k : kernels)
+    {
+      Compare(k.name, k.kernel, input, 0, input.GetNRates(), weight);
+      for (std::size_t begin = 0; begin < input.GetNRates(); begin += 64)
+        {
+          Compare(k.name, k.kernel, input, begin, std::min(begin + 64, input.GetNRates()),
+                  weight);
+        }
+    }
+
+  // The reference must reproduce the run
+  Tables expected(input);
+  UpdateRateStatsScalar(expected.Get(), expected.Get().txTime, 0, input.GetNRates(), weight);
+  const TARARateStats& e = expected.Get();
+  for (const auto& entry : table)
+    {
+      std::size_t i = entry.first;
+      const TARAStatsRecord& r = entry.second;
+      if (in.numRateAttempt[i] == 0)
+        {
+          continue;
+        }
+      CheckExact("record", "prob", i, 0, input.GetNRates(), r.prob, e.prob[i]);
+      CheckClose("record", "ewmaProb", i, 0, input.GetNRates(), r.ewmaProb, e.ewmaProb[i]);
+      CheckClose("record", "ewmsdProb", i, 0, input.GetNRates(), r.ewmsdProb, e.ewmsdProb[i]);
+    }
+}
+
+// Replay all the tables of a statistics file; returns the number of tables
+static uint64_t
+Replay(const std::vector<Candidate>& kernels, const std::string& input, double weight)
+{
+  std::ifstream in;
+  TARAStatsFileHeader header;
+  if (!OpenTARAFile<TARAStatsRecord>(input, TARA_STATS_MAGIC, TARA_STATS_VERSION, "statistics",
+                                     "record", in, header))
+    {
+      std::exit(1);
+    }
+
+  // The records of a table are consecutive and share the time and the station
+  std::map<uint64_t, RecordedTable> lastTables;
+  RecordedTable table;
+  uint64_t station = 0;
+  int64_t time = 0;
+  uint64_t nTables = 0;
+  TARAStatsRecord record;
+  for (uint64_t n = 0; n <= header.nRecords; n++)
+    {
+      bool haveRecord = n < header.nRecords;
+      if (haveRecord && !in.read(reinterpret_cast<char*>(&record), sizeof(record)))
+        {
+          std::cerr << input << ": truncated after " << n << " records" << std::endl;
+          haveRecord = false;
+        }
+      uint64_t address = 0;
+      if (haveRecord)
+        {
+          std::memcpy(&address, record.station, sizeof(record.station));
+        }
+      if (!table.empty() && (!haveRecord || address != station || record.time != time))
+        {
+          auto last = lastTables.find(station);
+          ReplayTable(kernels, table, last != lastTables.end() ? &last->second : nullptr, weight);
+          lastTables[station] = table;
+          table.clear();
+          nTables++;
+        }
+      if (!haveRecord)
+        {
+          break;
+        }
+      station = address;
+      time = record.time;
+      table[record.index] = record;
+    }
+  std::cout << "kernel-test: " << input << ": " << nTables << " tables of "
+            << lastTables.size() << " stations, " << g_replayedRates << " rate updates replayed, "
+            << g_skippedRates << " without a previous table" << std::endl;
+  return nTables;
+}
+
+int
+main(int argc, char** argv)
+{
+  uint32_t seed = 1;
+  uint32_t nTables = 200;
+  std::string input;
+  double ewmaLevel = 75;
+
+  CommandLine cmd;
+  cmd.AddValue("seed", "seed of the random tables", seed);
+  cmd.AddValue("nTables", "number of random tables", nTables);
+  cmd.AddValue("input", "statistics file recorded with PrintStats, replayed instead", input);
+  cmd.AddValue("ewmaLevel", "EWMA attribute of the run the input was recorded from", ewmaLevel);
+  cmd.Parse(argc, argv);
+
+  std::vector<Candidate> kernels;
+#if defined(__AVX2__)
+#if defined(__GNUC__)
+  if (!__builtin_cpu_supports("avx2"))
+    {
+      std::cout << "kernel-test: AVX2 not supported by this CPU, skipped" << std::endl;
+      return 0;
+    }
+#endif
+  kernels.push_back({"UpdateRateStatsAvx2", &UpdateRateStatsAvx2, 4});
+#endif
+#if defined(__SSE2__)
+  kernels.push_back({"UpdateRateStatsSse2", &UpdateRateStatsSse2, 2});
+#endif
+  kernels.push_back({"UpdateRateStatsKernel", &UpdateRateStatsKernel, 4});
+
+  if (!input.empty())
+    {
+      if (Replay(kernels, input, ewmaLevel) == 0)
+        {
+          std::cerr << input << ": no statistics table" << std::endl;
+          return 1;
+        }
+      PrintSummary(kernels);
+      return 0;
+    }
+
+  std::mt19937 rng(seed);
+  const double weights[] = {0, 25, 50, 75, 100};
+
+  // Every combination of lane states over 8 rates: 2 AVX2 steps, 4 SSE2 steps
+  const std::size_t nLanes = 8;
+  uint32_t nCombinations = 1;
+  for (std::size_t lane = 0; lane < nLanes; lane++)
+    {
+      nCombinations *= Tables::N_LANE_STATES;
+    }
+  Tables lanes(16);
+  for (std::size_t i = 0; i < lanes.GetNRates(); i++)
+    {
+      lanes.SetLane(i, Tables::UPDATE, rng);
+    }
+  for (uint32_t combination = 0; combination < nCombinations; combination++)
+    {
+      uint32_t states = combination;
+      for (std::size_t lane = 0; lane < nLanes; lane++)
+        {
+          lanes.SetLane(lane, static_cast<Tables::LaneState>(states % Tables::N_LANE_STATES), rng);
+          states /= Tables::N_LANE_STATES;
+        }
+      double weight = weights[combination % 5];
+      for (const auto& k : kernels)
+        {
+          Compare(k.name, k.kernel, lanes, 0, nLanes, weight);
+          // A tail of 1 to 7 rates after the block
+          Compare(k.name, k.kernel, lanes, 0, nLanes + 1 + combination % 7, weight);
+          // The block as a tail
+          Compare(k.name, k.kernel, lanes, 0, 1 + combination % nLanes, weight);
+        }
+    }
+
+  // Random tables, of the size of the tables of an 802.11ac station
+  std::uniform_int_distribution<int> state(0, Tables::N_LANE_STATES - 1);
+  std::uniform_real_distribution<double> anyWeight(0, 100);
+  for (uint32_t t = 0; t < nTables; t++)
+    {
+      Tables tables(160);
+      for (std::size_t i = 0; i < tables.GetNRates(); i++)
+        {
+          tables.SetLane(i, static_cast<Tables::LaneState>(state(rng)), rng);
+        }
+      double weight = t % 2 == 0 ? weights[t / 2 % 5] : anyWeight(rng);
+      for (const auto& k : kernels)
+        {
+          for (std::size_t begin : {0, 8, 16, 64})
+            {
+              for (std::size_t length = 0; length <= 67; length++)
+                {
+                  if (begin % k.width == 0)
+                    {
+                      Compare(k.name, k.kernel, tables, begin, begin + length, weight);
+                    }
+                }
+            }
+        }
+    }
+
+  PrintSummary(kernels);
+  return 0;
+}
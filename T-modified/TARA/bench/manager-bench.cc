@@ -0,0 +1,372 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Benchmark of the TARAWifiManager callbacks on the per-frame path, without
+// traffic, applications or channel activity: a single device is installed
+// (its PHY and MAC only provide the timings and capabilities the manager
+// reads), N synthetic stations are associated to its manager and a feedback
+// sequence is replayed on them. The feedback is either synthetic or read from
+// a file with one "<station> <#successful MPDUs> <#failed MPDUs>" line per
+// A-MPDU. For each callback, the time, the heap allocations and (on Linux,
+// when perf_event is available) the cache misses per call are reported, after
+// the heap bytes allocated per station by their creation and initialization.
+//
+// FindRate runs from the feedback callbacks.
+//
+// UpdateStats runs from the feedback callbacks once per stats interval. It is
+// measured by replaying the A-MPDU feedback with an interval of zero and
+// comparing with the default interval (simulation time does not advance).
+//
+// FindRate and UpdateStats are also called directly on the stations of the
+// manager: UpdateStats after the replay of one A-MPDU feedback of the station,
+// which is not measured. This needs the benchmark hooks of the manager (ns-3
+// configured with -DTARA_BENCH_HOOKS=ON).
+// With --batched, the manager updates the statistics from its periodic event
+// (BatchedStatsUpdate) and the feedback callbacks never run UpdateStats. The
+// simulator then runs one stats interval at a time, after the replay of one
+// A-MPDU feedback per station, which is not measured, so that each run fires
+// the periodic event once and updates the statistics of all the stations.
+//
+// The results (heap bytes per station and time per call) can be written with
+// --output and compared with those of a baseline run with --baseline: the
+// program exits with 1 if a result exceeds its baseline by more than
+// --tolerance (a fraction of the baseline).
+
+#include <ns3/core-module.h>
+#include <ns3/mobility-module.h>
+#include <ns3/network-module.h>
+#include <ns3/wifi-module.h>
+#include <ns3/tara-wifi-manager.h>
+
+#include "bench-common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace ns3;
+
+struct Feedback
+{
+  uint32_t station;
+  uint16_t nSuccessful;
+  uint16_t nFailed;
+};
+
+// Results of a run, by measurement name
+typedef std::map<std::string, double> Results;
+
+// One "<value>\t<name>" line per result
+static void
+WriteResults(const std::string& fileName, const Results& results)
+{
+  std::ofstream out(fileName);
+  NS_ABORT_MSG_IF(!out, "Cannot write " << fileName);
+  out.precision(10);
+  for (const auto& result : results)
+    {
+      out << result.second << "\t" << result.first << "\n";
+    }
+}
+
+static Results
+ReadResults(const std::string& fileName)
+{
+  std::ifstream in(fileName);
+  NS_ABORT_MSG_IF(!in, "Cannot open " << fileName);
+  Results results;
+  std::string line;
+  while (std::getline(in, line))
+    {
+      std::size_t tab = line.find('\t');
+      if (tab != std::string::npos)
+        {
+          results[line.substr(tab + 1)] = std::stod(line.substr(0, tab));
+        }
+    }
+  return results;
+}
+
+// Number of results above their baseline by more than the tolerance, each reported
+static uint32_t
+CompareResults(const Results& results, const Results& baseline, double tolerance)
+{
+  uint32_t nRegressions = 0;
+  for (const auto& reference : baseline)
+    {
+      auto result = results.find(reference.first);
+      if (result == results.end())
+        {
+          std::cout << "not measured: " << reference.first << std::endl;
+          continue;
+        }
+      double change = reference.second > 0 ? result->second / reference.second - 1 : 0;
+      if (change > tolerance)
+        {
+          std::cout << "REGRESSION " << reference.first << ": " << result->second << " vs "
+                    << reference.second << " (+" << 100 * change << "%)" << std::endl;
+          nRegressions++;
+        }
+    }
+  return nRegressions;
+}
+
+#ifdef TARA_BENCH_HOOKS
+// Direct access to the rate control of the stations of a TARAWifiManager
+class TARAManagerBench
+{
+public:
+  static TARAWifiRemoteStation* GetStation(Ptr<WifiRemoteStationManager> manager,
+                                           Mac48Address address)
+  {
+    return DynamicCast<TARAWifiManager>(manager)->GetPooledStation(address);
+  }
+
+  static uint16_t FindRate(Ptr<WifiRemoteStationManager> manager, TARAWifiRemoteStation* station)
+  {
+    return DynamicCast<TARAWifiManager>(manager)->FindRate(station);
+  }
+
+  static void UpdateStats(Ptr<WifiRemoteStationManager> manager, TARAWifiRemoteStation* station)
+  {
+    DynamicCast<TARAWifiManager>(manager)->UpdateStats(station);
+  }
+};
+#endif
+
+static Ptr<WifiRemoteStationManager>
+CreateManager(WifiStandard standard, uint16_t width, Time updateStats, bool batched)
+{
+  Ptr<Node> node = CreateObject<Node>();
+  MobilityHelper mobility;
+  mobility.Install(node);
+
+  WifiHelper wifi;
+  wifi.SetStandard(standard);
+  wifi.SetRemoteStationManager("ns3::TARAWifiManager", "UpdateStatistics",
+                               TimeValue(updateStats), "BatchedStatsUpdate",
+                               BooleanValue(batched));
+  YansWifiPhyHelper phy;
+  phy.SetChannel(YansWifiChannelHelper::Default().Create());
+  phy.Set("ChannelSettings", StringValue("{0, " + std::to_string(width) + ", BAND_5GHZ, 0}"));
+  WifiMacHelper mac;
+  mac.SetType("ns3::AdhocWifiMac");
+  Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice>(wifi.Install(phy, mac, node).Get(0));
+  // The simulation does not run: initialize the manager (MCS groups, TxTime tables) here
+  node->Initialize();
+  return device->GetRemoteStationManager();
+}
+
+static std::vector<Mac48Address>
+AddStations(Ptr<WifiRemoteStationManager> manager, uint32_t nStations)
+{
+  Ptr<WifiMac> mac = manager->GetMac();
+  std::vector<Mac48Address> stations;
+  for (uint32_t i = 0; i < nStations; i++)
+    {
+      Mac48Address address = Mac48Address::Allocate();
+      manager->AddAllSupportedModes(address);
+      manager->AddAllSupportedMcs(address);
+      manager->AddStationHtCapabilities(address, mac->GetHtCapabilities(SINGLE_LINK_OP_ID));
+      if (mac->GetVhtSupported(SINGLE_LINK_OP_ID))
+        {
+          manager->AddStationVhtCapabilities(address, mac->GetVhtCapabilities(SINGLE_LINK_OP_ID));
+        }
+      stations.push_back(address);
+    }
+  return stations;
+}
+
+int
+main(int argc, char** argv)
+{
+  uint32_t nStations = 16;
+  uint32_t nCalls = 1000000;
+  std::string feedbackFile;
+  std::string standard = "n";
+  uint16_t width = 20;
+  bool batched = false;
+  std::string outputFile;
+  std::string baselineFile;
+  double tolerance = 0.1;
+
+  CommandLine cmd;
+  cmd.AddValue("nStations", "number of synthetic stations", nStations);
+  cmd.AddValue("nCalls", "number of calls per callback", nCalls);
+  cmd.AddValue("feedback", "file of A-MPDU feedback to replay (synthetic if empty)",
+               feedbackFile);
+  cmd.AddValue("standard", "802.11 standard: n or ac", standard);
+  cmd.AddValue("width", "channel width (MHz)", width);
+  cmd.AddValue("batched", "update the statistics from the periodic event of the manager",
+               batched);
+  cmd.AddValue("output", "file where the results are written", outputFile);
+  cmd.AddValue("baseline", "results of a baseline run, to compare with", baselineFile);
+  cmd.AddValue("tolerance", "largest increase over the baseline (fraction)", tolerance);
+  cmd.Parse(argc, argv);
+
+  WifiStandard wifiStandard = standard == "ac" ? WIFI_STANDARD_80211ac : WIFI_STANDARD_80211n;
+
+  // Feedback sequence, identical for all the measurements
+  std::vector<Feedback> feedback;
+  if (!feedbackFile.empty())
+    {
+      std::ifstream in(feedbackFile);
+      Feedback f;
+      while (in >> f.station >> f.nSuccessful >> f.nFailed)
+        {
+          f.station %= nStations;
+          feedback.push_back(f);
+        }
+      NS_ABORT_MSG_IF(feedback.empty(), "No feedback read from " << feedbackFile);
+    }
+  else
+    {
+      uint32_t seed = 12345;
+      feedback.resize(4096);
+      for (auto& f : feedback)
+        {
+          seed = seed * 1103515245 + 12345;
+          f.station = (seed >> 8) % nStations;
+          // A-MPDUs of 1 to 16 MPDUs, a quarter of them with losses
+          uint16_t nMpdus = 1 + (seed >> 16) % 16;
+          f.nFailed = (seed >> 20) % 4 == 0 ? (seed >> 12) % (nMpdus + 1) : 0;
+          f.nSuccessful = nMpdus - f.nFailed;
+        }
+    }
+
+  Results results;
+  CacheMissCounter misses;
+  std::cout << "stations=" << nStations << " calls=" << nCalls << " feedback="
+            << (feedbackFile.empty() ? "synthetic" : feedbackFile) << " standard=802.11"
+            << standard << " width=" << width << (batched ? " batched" : "")
+            << (misses.IsAvailable() ? "" : " (cache misses not available)") << "\n";
+
+  Time defaultInterval = MilliSeconds(100);
+  for (Time interval : {defaultInterval, Seconds(0)})
+    {
+      Ptr<WifiRemoteStationManager> manager = CreateManager(wifiStandard, width, interval, batched);
+      uint64_t stationBytes = g_allocatedBytes.load();
+      std::vector<Mac48Address> stations = AddStations(manager, nStations);
+      stationBytes = g_allocatedBytes.load() - stationBytes;
+
+      std::vector<WifiMacHeader> headers(nStations);
+      std::vector<Ptr<WifiMpdu>> mpdus(nStations);
+      for (uint32_t i = 0; i < nStations; i++)
+        {
+          headers[i].SetType(WIFI_MAC_QOSDATA);
+          headers[i].SetAddr1(stations[i]);
+          mpdus[i] = Create<WifiMpdu>(Create<Packet>(1200), headers[i]);
+        }
+      // The first call for a station initializes it: keep it out of the measurements
+      std::vector<WifiTxVector> txVectors(nStations);
+      uint64_t initBytes = g_allocatedBytes.load();
+      for (uint32_t i = 0; i < nStations; i++)
+        {
+          txVectors[i] = manager->GetDataTxVector(headers[i], width);
+        }
+      stationBytes += g_allocatedBytes.load() - initBytes;
+      if (!interval.IsZero())
+        {
+          // Bytes allocated for the stations: their capabilities, stored by the
+          // base manager, and their rate control state (not released until the end)
+          std::cout << std::left << std::setw(38) << "Heap per station" << std::right
+                    << std::setw(10) << static_cast<double>(stationBytes) / nStations
+                    << " bytes" << std::endl;
+          results["Heap per station"] = static_cast<double>(stationBytes) / nStations;
+        }
+
+      std::string suffix = interval.IsZero() ? " (UpdateStats on every call)" : "";
+      results["GetDataTxVector" + suffix] =
+          Measure("GetDataTxVector" + suffix, nCalls, misses, [&](uint32_t i) {
+            uint32_t station = feedback[i % feedback.size()].station;
+            txVectors[station] = manager->GetDataTxVector(headers[station], width);
+          });
+      results["ReportAmpduTxStatus" + suffix] =
+          Measure("ReportAmpduTxStatus" + suffix, nCalls, misses, [&](uint32_t i) {
+            const Feedback& f = feedback[i % feedback.size()];
+            manager->ReportAmpduTxStatus(stations[f.station], f.nSuccessful, f.nFailed, 30, 30,
+                                         txVectors[f.station]);
+          });
+      results["ReportDataOk" + suffix] =
+          Measure("ReportDataOk" + suffix, nCalls, misses, [&](uint32_t i) {
+            uint32_t station = feedback[i % feedback.size()].station;
+            manager->ReportDataOk(mpdus[station], 30, txVectors[station].GetMode(), 30,
+                                  txVectors[station]);
+          });
+
+      if (interval.IsZero())
+        {
+          continue;
+        }
+      if (batched)
+        {
+          uint32_t nTicks = std::max<uint32_t>(1, nCalls / nStations);
+          results["UpdateDueStats (per station)"] = MeasureEach(
+              "UpdateDueStats (per station)", nTicks, misses,
+              [&](uint32_t i) {
+                for (uint32_t j = 0; j < nStations; j++)
+                  {
+                    const Feedback& f = feedback[(i * nStations + j) % feedback.size()];
+                    manager->ReportAmpduTxStatus(stations[j], f.nSuccessful, f.nFailed, 30, 30,
+                                                 txVectors[j]);
+                  }
+              },
+              [&](uint32_t) {
+                Simulator::Stop(interval);
+                Simulator::Run();
+              },
+              nStations);
+        }
+#ifdef TARA_BENCH_HOOKS
+      // The feedback callbacks do not update the statistics in this interval
+      std::vector<TARAWifiRemoteStation*> pooled(nStations);
+      for (uint32_t i = 0; i < nStations; i++)
+        {
+          pooled[i] = TARAManagerBench::GetStation(manager, stations[i]);
+          NS_ABORT_MSG_IF(pooled[i] == nullptr, "Station " << stations[i] << " not found");
+        }
+      results["FindRate"] = Measure("FindRate", nCalls, misses, [&](uint32_t i) {
+        TARAManagerBench::FindRate(manager, pooled[feedback[i % feedback.size()].station]);
+      });
+      results["UpdateStats"] = MeasureEach(
+          "UpdateStats", nCalls, misses,
+          [&](uint32_t i) {
+            const Feedback& f = feedback[i % feedback.size()];
+            manager->ReportAmpduTxStatus(stations[f.station], f.nSuccessful, f.nFailed, 30, 30,
+                                         txVectors[f.station]);
+          },
+          [&](uint32_t i) {
+            TARAManagerBench::UpdateStats(manager, pooled[feedback[i % feedback.size()].station]);
+          });
+#endif
+    }
+
+  Simulator::Destroy();
+  if (!outputFile.empty())
+    {
+      WriteResults(outputFile, results);
+    }
+  if (!baselineFile.empty())
+    {
+      uint32_t nRegressions = CompareResults(results, ReadResults(baselineFile), tolerance);
+      std::cout << nRegressions << " regressions over " << baselineFile << " (tolerance "
+                << 100 * tolerance << "%)" << std::endl;
+      return nRegressions > 0 ? 1 : 0;
+    }
+  return 0;
+}
@@ -0,0 +1,107 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Benchmark of the delivery of a prediction to the TARAWifiManager of a
+// node, as scheduled by taraAlg, with N nodes of one TARA device each:
+// - Config::Set of the TARASnr attribute, through its configuration path
+//   (the historical delivery of the predicted SNR);
+// - Config::LookupMatches of the manager, through its configuration path,
+//   then SetTrajectory;
+// - DeliverTARATrajectory, on a handle resolved once.
+// For each path, the time, the heap allocations and (on Linux, when
+// perf_event is available) the cache misses per delivery are reported.
+
+#include "../lib/tara.h"
+
+#include <ns3/core-module.h>
+#include <ns3/mobility-module.h>
+#include <ns3/network-module.h>
+#include <ns3/wifi-module.h>
+
+#include "bench-common.h"
+
+#include <vector>
+
+using namespace ns3;
+
+int
+main(int argc, char** argv)
+{
+  uint32_t nNodes = 4;
+  uint32_t nCalls = 100000;
+
+  CommandLine cmd;
+  cmd.AddValue("nNodes", "number of nodes, with one TARA device each", nNodes);
+  cmd.AddValue("nCalls", "number of deliveries per path", nCalls);
+  cmd.Parse(argc, argv);
+
+  NodeContainer nodes;
+  nodes.Create(nNodes);
+  MobilityHelper mobility;
+  mobility.Install(nodes);
+
+  WifiHelper wifi;
+  wifi.SetStandard(WIFI_STANDARD_80211n);
+  wifi.SetRemoteStationManager("ns3::TARAWifiManager");
+  YansWifiPhyHelper phy;
+  phy.SetChannel(YansWifiChannelHelper::Default().Create());
+  WifiMacHelper mac;
+  mac.SetType("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install(phy, mac, nodes);
+
+  // Each node predicts the link towards the next one
+  std::vector<TARAPredictionTarget> targets;
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      Mac48Address peer = Mac48Address::ConvertFrom(devices.Get((i + 1) % nNodes)->GetAddress());
+      targets.push_back(ResolveTARAPredictionTarget(nodes.Get(i)->GetId(), 0, peer));
+    }
+  NodeMovInfo local;
+  local.current_pos = Vector(0, 0, 10);
+  local.velocity = Vector(8, 0, 0);
+  local.flight_duration = 5;
+  NodeMovInfo remote;
+  remote.current_pos = Vector(50, 0, 10);
+
+  CacheMissCounter misses;
+  std::cout << "nodes=" << nNodes << " calls=" << nCalls
+            << (misses.IsAvailable() ? "" : " (cache misses not available)") << "\n";
+
+  Measure("Config::Set TARASnr", nCalls, misses, [&](uint32_t i) {
+    uint32_t nodeId = nodes.Get(i % nNodes)->GetId();
+    Config::Set("/NodeList/" + std::to_string(nodeId) +
+                    "/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/"
+                    "$ns3::TARAWifiManager/TARASnr",
+                DoubleValue(20 + i % 10));
+  });
+  Measure("Config::LookupMatches + SetTrajectory", nCalls, misses, [&](uint32_t i) {
+    uint32_t n = i % nNodes;
+    Config::MatchContainer managers =
+        Config::LookupMatches("/NodeList/" + std::to_string(nodes.Get(n)->GetId()) +
+                              "/DeviceList/0/$ns3::WifiNetDevice/RemoteStationManager/"
+                              "$ns3::TARAWifiManager");
+    for (auto it = managers.Begin(); it != managers.End(); ++it)
+      {
+        DynamicCast<TARAWifiManager>(*it)->SetTrajectory(targets[n].peer, ToTARAMotion(local),
+                                                         ToTARAMotion(remote));
+      }
+  });
+  Measure("DeliverTARATrajectory", nCalls, misses,
+          [&](uint32_t i) { DeliverTARATrajectory(targets[i % nNodes], local, remote); });
+
+  Simulator::Destroy();
+  return 0;
+}
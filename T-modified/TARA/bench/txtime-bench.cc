@@ -0,0 +1,206 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Micro-benchmark of the TxTime lookups done by TARAWifiManager on the
+// per-frame path. GetMpduTxTime and GetFirstMpduTxTime are timed on the flat
+// tables of an initialized manager, indexed by the global rate index
+// (groupId * numRates + rateId), for the rates of its supported groups in a
+// pseudo-random order. For reference, the same times are copied to the former
+// layout, a std::map<WifiMode, Time> per group, and looked up in the same
+// order. This needs the benchmark hooks of the manager (ns-3 configured with
+// -DTARA_BENCH_HOOKS=ON).
+
+#include <ns3/core-module.h>
+#include <ns3/mobility-module.h>
+#include <ns3/network-module.h>
+#include <ns3/wifi-module.h>
+#include <ns3/tara-wifi-manager.h>
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+using namespace ns3;
+
+// Direct access to the TxTime tables of a TARAWifiManager
+class TARAManagerBench
+{
+public:
+  static const McsGroup& GetGroup(const TARAWifiManager& manager, uint8_t groupId)
+  {
+    return manager.m_minstrelGroups[groupId];
+  }
+
+  static uint8_t GetNumGroups(const TARAWifiManager& manager)
+  {
+    return manager.m_numGroups;
+  }
+
+  static uint8_t GetNumRates(const TARAWifiManager& manager)
+  {
+    return manager.m_numRates;
+  }
+
+  static bool HasTxTime(const TARAWifiManager& manager, uint8_t groupId, uint8_t rateId)
+  {
+    return !manager.m_ratesTxTimeTable[manager.GetIndex(groupId, rateId)].IsZero();
+  }
+
+  static Time GetMpduTxTime(const TARAWifiManager& manager, uint8_t groupId, uint8_t rateId)
+  {
+    return manager.GetMpduTxTime(groupId, rateId);
+  }
+
+  static Time GetFirstMpduTxTime(const TARAWifiManager& manager, uint8_t groupId, uint8_t rateId)
+  {
+    return manager.GetFirstMpduTxTime(groupId, rateId);
+  }
+};
+
+static Ptr<TARAWifiManager>
+CreateManager(WifiStandard standard, uint16_t width, uint8_t nStreams)
+{
+  Ptr<Node> node = CreateObject<Node>();
+  MobilityHelper mobility;
+  mobility.Install(node);
+
+  WifiHelper wifi;
+  wifi.SetStandard(standard);
+  wifi.SetRemoteStationManager("ns3::TARAWifiManager");
+  YansWifiPhyHelper phy;
+  phy.SetChannel(YansWifiChannelHelper::Default().Create());
+  phy.Set("ChannelSettings", StringValue("{0, " + std::to_string(width) + ", BAND_5GHZ, 0}"));
+  phy.Set("Antennas", UintegerValue(nStreams));
+  phy.Set("MaxSupportedTxSpatialStreams", UintegerValue(nStreams));
+  WifiMacHelper mac;
+  mac.SetType("ns3::AdhocWifiMac");
+  Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice>(wifi.Install(phy, mac, node).Get(0));
+  // The simulation does not run: initialize the manager (MCS groups, TxTime tables) here
+  node->Initialize();
+  return DynamicCast<TARAWifiManager>(device->GetRemoteStationManager());
+}
+
+// WifiMode of a rate of a group, the key of the former per-group maps
+static WifiMode
+GetMode(const McsGroup& group, uint8_t rateId)
+{
+  switch (group.type)
+    {
+    case WIFI_MINSTREL_GROUP_HT:
+      return HtPhy::GetHtMcs(rateId + (group.streams - 1) * MAX_HT_GROUP_RATES);
+    case WIFI_MINSTREL_GROUP_VHT:
+      return VhtPhy::GetVhtMcs(rateId);
+    default:
+      return HePhy::GetHeMcs(rateId);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+  uint32_t nLookups = 10000000;
+  std::string standard = "ac";
+  uint16_t width = 80;
+  uint16_t nStreams = 2;
+
+  CommandLine cmd;
+  cmd.AddValue("nLookups", "number of lookups per table", nLookups);
+  cmd.AddValue("standard", "802.11 standard: n or ac", standard);
+  cmd.AddValue("width", "channel width (MHz)", width);
+  cmd.AddValue("nStreams", "number of spatial streams of the PHY", nStreams);
+  cmd.Parse(argc, argv);
+
+  WifiStandard wifiStandard = standard == "ac" ? WIFI_STANDARD_80211ac : WIFI_STANDARD_80211n;
+  Ptr<TARAWifiManager> manager = CreateManager(wifiStandard, width, nStreams);
+  const TARAWifiManager& tables = *manager;
+
+  // Rates with a TxTime, and their times in the former layout
+  struct Rate
+  {
+    uint8_t groupId;
+    uint8_t rateId;
+    WifiMode mode;
+  };
+
+  std::vector<Rate> rates;
+  std::vector<std::map<WifiMode, Time>> mapTables;
+  std::vector<std::map<WifiMode, Time>> firstMapTables;
+  uint8_t nRates = TARAManagerBench::GetNumRates(tables);
+  for (uint8_t groupId = 0; groupId < TARAManagerBench::GetNumGroups(tables); groupId++)
+    {
+      mapTables.emplace_back();
+      firstMapTables.emplace_back();
+      const McsGroup& group = TARAManagerBench::GetGroup(tables, groupId);
+      if (!group.isSupported)
+        {
+          continue;
+        }
+      for (uint8_t rateId = 0; rateId < nRates; rateId++)
+        {
+          if (!TARAManagerBench::HasTxTime(tables, groupId, rateId))
+            {
+              continue;
+            }
+          WifiMode mode = GetMode(group, rateId);
+          rates.push_back({groupId, rateId, mode});
+          mapTables[groupId].insert(
+              std::make_pair(mode, TARAManagerBench::GetMpduTxTime(tables, groupId, rateId)));
+          firstMapTables[groupId].insert(
+              std::make_pair(mode, TARAManagerBench::GetFirstMpduTxTime(tables, groupId, rateId)));
+        }
+    }
+  NS_ABORT_MSG_IF(rates.empty(), "No TxTime in the tables of the manager");
+
+  // Pseudo-random rate sequence, identical for both layouts
+  std::vector<uint16_t> indexes(4096);
+  uint32_t seed = 12345;
+  for (auto& index : indexes)
+    {
+      seed = seed * 1103515245 + 12345;
+      index = (seed >> 8) % rates.size();
+    }
+
+  int64_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nLookups; i++)
+    {
+      const Rate& rate = rates[indexes[i % indexes.size()]];
+      sum += mapTables[rate.groupId].find(rate.mode)->second.GetTimeStep();
+      sum += firstMapTables[rate.groupId].find(rate.mode)->second.GetTimeStep();
+    }
+  auto mapTime = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nLookups; i++)
+    {
+      const Rate& rate = rates[indexes[i % indexes.size()]];
+      sum -= TARAManagerBench::GetMpduTxTime(tables, rate.groupId, rate.rateId).GetTimeStep();
+      sum -= TARAManagerBench::GetFirstMpduTxTime(tables, rate.groupId, rate.rateId).GetTimeStep();
+    }
+  auto flatTime = std::chrono::steady_clock::now() - start;
+
+  double mapNs = std::chrono::duration<double, std::nano>(mapTime).count() / (2.0 * nLookups);
+  double flatNs = std::chrono::duration<double, std::nano>(flatTime).count() / (2.0 * nLookups);
+
+  std::cout << "standard=802.11" << standard << " width=" << width << " streams=" << nStreams
+            << " rates=" << rates.size()
+            << " lookups=" << 2 * nLookups << "\n"
+            << "std::map<WifiMode, Time> per group: " << mapNs << " ns/lookup\n"
+            << "TARAWifiManager flat tables:        " << flatNs << " ns/lookup\n"
+            << "speed-up: " << mapNs / flatNs << "x (checksum " << sum << ", 0 expected)"
+            << std::endl;
+  return sum == 0 ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2009 Duy Nguyen
+ * Copyright (c) 2015 Ghada Badawy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *Authors: Duy Nguyen <duy@soe.ucsc.edu>
+ *         Ghada Badawy <gbadawy@gmail.com>
+ *         Matias Richart <mrichart@fing.edu.uy>
+ *
+ * Statistics update kernels of the TARA rate manager: the scalar reference and
+ * its SSE2 and AVX2 vectorizations, compiled in when the target supports them.
+ * They are used by TARAWifiManager::UpdateRateStats, and compared with each
+ * other by bench/kernel-test.cc.
+ */
+
+#ifndef TARA_RATE_STATS_KERNEL_H
+#define TARA_RATE_STATS_KERNEL_H
+
+#include "tara-wifi-manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ns3
+{
+
+/**
+ * Statistics update of the rate entries [begin, end) of a station, one rate at a time.
+ * This is the reference implementation of the update kernel:
+ *
+ *   prob       = floor(100 * success / attempts)
+ *   ewmsdProb  = sqrt(w * (ewmsd^2 + diff * (100 - w) * diff / 100) / 100), diff = prob - ewma
+ *   ewmaProb   = (prob * (100 - w) + ewma * w) / 100
+ *   throughput = 0 if ewmaProb < 10, else min(ewmaProb, 90) / perfectTxTime
+ *
+ * On the first update with successes of a rate (no success so far), ewmaProb is
+ * set to prob and ewmsdProb is left unchanged. Rates not supported or not attempted
+ * are left unchanged.
+ *
+ * \param stats the statistics arrays of the station
+ * \param txTime the perfect transmit time of the rates (seconds)
+ * \param begin the first entry to update
+ * \param end the entry after the last one to update
+ * \param weight the EWMA level
+ */
+inline void
+UpdateRateStatsScalar(const TARARateStats& stats,
+                      const double* txTime,
+                      std::size_t begin,
+                      std::size_t end,
+                      double weight)
+{
+    for (std::size_t i = begin; i < end; i++)
+    {
+        if (stats.supported[i] == 0 || stats.numRateAttempt[i] == 0)
+        {
+            continue;
+        }
+        double prob = (100 * stats.numRateSuccess[i]) / stats.numRateAttempt[i];
+        stats.prob[i] = prob;
+        if (stats.successHist[i] == 0)
+        {
+            stats.ewmaProb[i] = prob;
+        }
+        else
+        {
+            double diff = prob - stats.ewmaProb[i];
+            double incr = (100 - weight) * diff / 100;
+            double tmp = stats.ewmsdProb[i] * stats.ewmsdProb[i];
+            tmp = weight * (tmp + diff * incr) / 100;
+            stats.ewmsdProb[i] = sqrt(tmp);
+            stats.ewmaProb[i] = (prob * (100 - weight) + stats.ewmaProb[i] * weight) / 100;
+        }
+        double ewmaProb = stats.ewmaProb[i];
+        stats.throughput[i] = (ewmaProb < 10) ? 0 : std::min(ewmaProb, 90.0) / txTime[i];
+    }
+}
+
+/*
+ * The vectorized kernels have the same arithmetic as UpdateRateStatsScalar: the
+ * supported and attempted rates, and the rates with a first success, are
+ * selected with lane masks rather than branches.
+ *
+ * The operations and their order are those of the scalar code, so results are
+ * identical unless the compiler contracts multiply-adds into FMA instructions
+ * (e.g., -mfma with -ffp-contract=fast), in which case the EWMA, EWMSD and
+ * throughput may differ from the scalar path by a few ULPs (relative error
+ * below TARA_KERNEL_TOLERANCE). The success probability is always exact (it is
+ * truncated to an integer, as the integer division of the scalar code) as long
+ * as the number of successes does not exceed the number of attempts.
+ */
+
+/// Largest relative error of the vectorized kernels with respect to UpdateRateStatsScalar
+static const double TARA_KERNEL_TOLERANCE = 1e-12;
+
+#if defined(__AVX2__)
+/**
+ * Statistics update of the rate entries [begin, end) of a station, 4 rates per
+ * step with AVX2. The last end - begin modulo 4 entries are updated by
+ * UpdateRateStatsScalar.
+ *
+ * \param stats the statistics arrays of the station
+ * \param txTime the perfect transmit time of the rates (seconds)
+ * \param begin the first entry to update (a multiple of 4)
+ * \param end the entry after the last one to update
+ * \param weight the EWMA level
+ */
+inline void
+UpdateRateStatsAvx2(const TARARateStats& stats,
+                    const double* txTime,
+                    std::size_t begin,
+                    std::size_t end,
+                    double weight)
+{
+    std::size_t i = begin;
+    const __m256d hundred = _mm256_set1_pd(100);
+    const __m256d ten = _mm256_set1_pd(10);
+    const __m256d ninety = _mm256_set1_pd(90);
+    const __m256d w = _mm256_set1_pd(weight);
+    const __m256d wc = _mm256_set1_pd(100 - weight);
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128i attempts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stats.numRateAttempt + i));
+        __m128i successes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stats.numRateSuccess + i));
+        __m128i supported = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stats.supported + i));
+        __m128i update32 =
+            _mm_andnot_si128(_mm_cmpeq_epi32(attempts, _mm_setzero_si128()), supported);
+        if (_mm_movemask_epi8(update32) == 0)
+        {
+            continue;
+        }
+        __m256d update = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(update32));
+        __m256i successHist = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stats.successHist + i));
+        __m256d first =
+            _mm256_castsi256_pd(_mm256_cmpeq_epi64(successHist, _mm256_setzero_si256()));
+
+        // Counters are far below 2^31: signed conversions are exact
+        __m256d prob = _mm256_div_pd(_mm256_mul_pd(hundred, _mm256_cvtepi32_pd(successes)),
+                                     _mm256_cvtepi32_pd(attempts));
+        prob = _mm256_round_pd(prob, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        __m256d ewma = _mm256_loadu_pd(stats.ewmaProb + i);
+        __m256d ewmsd = _mm256_loadu_pd(stats.ewmsdProb + i);
+        __m256d diff = _mm256_sub_pd(prob, ewma);
+        __m256d incr = _mm256_div_pd(_mm256_mul_pd(wc, diff), hundred);
+        __m256d tmp = _mm256_mul_pd(ewmsd, ewmsd);
+        tmp = _mm256_div_pd(_mm256_mul_pd(w, _mm256_add_pd(tmp, _mm256_mul_pd(diff, incr))),
+                            hundred);
+        __m256d newEwmsd = _mm256_blendv_pd(_mm256_sqrt_pd(tmp), ewmsd, first);
+        __m256d newEwma = _mm256_div_pd(
+            _mm256_add_pd(_mm256_mul_pd(prob, wc), _mm256_mul_pd(ewma, w)),
+            hundred);
+        newEwma = _mm256_blendv_pd(newEwma, prob, first);
+
+        __m256d th = _mm256_div_pd(_mm256_min_pd(newEwma, ninety), _mm256_loadu_pd(txTime + i));
+        th = _mm256_andnot_pd(_mm256_cmp_pd(newEwma, ten, _CMP_LT_OQ), th);
+
+        _mm256_storeu_pd(stats.prob + i,
+                         _mm256_blendv_pd(_mm256_loadu_pd(stats.prob + i), prob, update));
+        _mm256_storeu_pd(stats.ewmaProb + i, _mm256_blendv_pd(ewma, newEwma, update));
+        _mm256_storeu_pd(stats.ewmsdProb + i, _mm256_blendv_pd(ewmsd, newEwmsd, update));
+        _mm256_storeu_pd(stats.throughput + i,
+                         _mm256_blendv_pd(_mm256_loadu_pd(stats.throughput + i), th, update));
+    }
+    UpdateRateStatsScalar(stats, txTime, i, end, weight);
+}
+#endif
+
+#if defined(__SSE2__)
+/**
+ * Statistics update of the rate entries [begin, end) of a station, 2 rates per
+ * step with SSE2. The last entry, if end - begin is odd, is updated by
+ * UpdateRateStatsScalar.
+ *
+ * \param stats the statistics arrays of the station
+ * \param txTime the perfect transmit time of the rates (seconds)
+ * \param begin the first entry to update (a multiple of 2)
+ * \param end the entry after the last one to update
+ * \param weight the EWMA level
+ */
+inline void
+UpdateRateStatsSse2(const TARARateStats& stats,
+                    const double* txTime,
+                    std::size_t begin,
+                    std::size_t end,
+                    double weight)
+{
+    std::size_t i = begin;
+    const __m128d hundred = _mm_set1_pd(100);
+    const __m128d ten = _mm_set1_pd(10);
+    const __m128d ninety = _mm_set1_pd(90);
+    const __m128d w = _mm_set1_pd(weight);
+    const __m128d wc = _mm_set1_pd(100 - weight);
+    for (; i + 2 <= end; i += 2)
+    {
+        __m128i attempts = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(stats.numRateAttempt + i));
+        __m128i successes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(stats.numRateSuccess + i));
+        __m128i supported = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(stats.supported + i));
+        __m128i update32 =
+            _mm_andnot_si128(_mm_cmpeq_epi32(attempts, _mm_setzero_si128()), supported);
+        if ((_mm_movemask_epi8(update32) & 0xff) == 0)
+        {
+            continue;
+        }
+        __m128d update = _mm_castsi128_pd(_mm_unpacklo_epi32(update32, update32));
+        // 64-bit equality from the two 32-bit halves
+        __m128i zeroHist = _mm_cmpeq_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(stats.successHist + i)),
+            _mm_setzero_si128());
+        __m128d first = _mm_castsi128_pd(
+            _mm_and_si128(zeroHist, _mm_shuffle_epi32(zeroHist, _MM_SHUFFLE(2, 3, 0, 1))));
+
+        // Counters are far below 2^31: signed conversions are exact
+        __m128d prob = _mm_div_pd(_mm_mul_pd(hundred, _mm_cvtepi32_pd(successes)),
+                                  _mm_cvtepi32_pd(attempts));
+        prob = _mm_cvtepi32_pd(_mm_cvttpd_epi32(prob));
+
+        __m128d ewma = _mm_loadu_pd(stats.ewmaProb + i);
+        __m128d ewmsd = _mm_loadu_pd(stats.ewmsdProb + i);
+        __m128d diff = _mm_sub_pd(prob, ewma);
+        __m128d incr = _mm_div_pd(_mm_mul_pd(wc, diff), hundred);
+        __m128d tmp = _mm_mul_pd(ewmsd, ewmsd);
+        tmp = _mm_div_pd(_mm_mul_pd(w, _mm_add_pd(tmp, _mm_mul_pd(diff, incr))), hundred);
+        __m128d newEwmsd =
+            _mm_or_pd(_mm_and_pd(first, ewmsd), _mm_andnot_pd(first, _mm_sqrt_pd(tmp)));
+        __m128d newEwma =
+            _mm_div_pd(_mm_add_pd(_mm_mul_pd(prob, wc), _mm_mul_pd(ewma, w)), hundred);
+        newEwma = _mm_or_pd(_mm_and_pd(first, prob), _mm_andnot_pd(first, newEwma));
+
+        __m128d th = _mm_div_pd(_mm_min_pd(newEwma, ninety), _mm_loadu_pd(txTime + i));
+        th = _mm_andnot_pd(_mm_cmplt_pd(newEwma, ten), th);
+
+        _mm_storeu_pd(stats.prob + i,
+                      _mm_or_pd(_mm_and_pd(update, prob),
+                                _mm_andnot_pd(update, _mm_loadu_pd(stats.prob + i))));
+        _mm_storeu_pd(stats.ewmaProb + i,
+                      _mm_or_pd(_mm_and_pd(update, newEwma), _mm_andnot_pd(update, ewma)));
+        _mm_storeu_pd(stats.ewmsdProb + i,
+                      _mm_or_pd(_mm_and_pd(update, newEwmsd), _mm_andnot_pd(update, ewmsd)));
+        _mm_storeu_pd(stats.throughput + i,
+                      _mm_or_pd(_mm_and_pd(update, th),
+                                _mm_andnot_pd(update, _mm_loadu_pd(stats.throughput + i))));
+    }
+    UpdateRateStatsScalar(stats, txTime, i, end, weight);
+}
+#endif
+
+/**
+ * Statistics update of the rate entries [begin, end) of a station, with the
+ * widest kernel the target supports: AVX2, SSE2 or the scalar reference.
+ *
+ * \param stats the statistics arrays of the station
+ * \param txTime the perfect transmit time of the rates (seconds)
+ * \param begin the first entry to update (a multiple of the SIMD width)
+ * \param end the entry after the last one to update
+ * \param weight the EWMA level
+ */
+inline void
+UpdateRateStatsKernel(const TARARateStats& stats,
+                      const double* txTime,
+                      std::size_t begin,
+                      std::size_t end,
+                      double weight)
+{
+#if defined(__AVX2__)
+    UpdateRateStatsAvx2(stats, txTime, begin, end, weight);
+#elif defined(__SSE2__)
+    UpdateRateStatsSse2(stats, txTime, begin, end, weight);
+#else
+    UpdateRateStatsScalar(stats, txTime, begin, end, weight);
+#endif
+}
+
+} // namespace ns3
+
+#endif /* TARA_RATE_STATS_KERNEL_H */
@@ -35,26 +35,642 @@
 
 #include "tara-wifi-manager.h"
 
+#include "tara-rate-stats-kernel.h"
+
 #include "ns3/log.h"
 #include "ns3/packet.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/simulator.h"
 #include "ns3/wifi-mac.h"
+#include "ns3/wifi-mpdu.h"
 #include "ns3/wifi-phy.h"
 
-#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TARA_STATS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * With TARA_STRIP_LOGS (the TARA_STRIP_LOGS option of the wifi module), the
+ * log statements of this file compile to nothing, as in the optimized ns-3
+ * builds, whatever the logging configuration of the rest of ns-3: the
+ * rate-control decisions are then only recorded by the tracepoints
+ * (\see TARAWifiManager::Tracepoint).
+ */
+#ifdef TARA_STRIP_LOGS
+#undef NS_LOG_FUNCTION
+#define NS_LOG_FUNCTION(parameters)                                                                \
+    do                                                                                             \
+    {                                                                                              \
+        if (false)                                                                                 \
+        {                                                                                          \
+            ns3::ParameterLogger(std::clog) << parameters;                                         \
+        }                                                                                          \
+    } while (false)
+#undef NS_LOG_DEBUG
+#define NS_LOG_DEBUG(msg)                                                                          \
+    do                                                                                             \
+    {                                                                                              \
+        if (false)                                                                                 \
+        {                                                                                          \
+            std::clog << msg;                                                                      \
+        }                                                                                          \
+    } while (false)
+#undef NS_LOG_INFO
+#define NS_LOG_INFO(msg) NS_LOG_DEBUG(msg)
+#endif
 
 #define Min(a, b) ((a < b) ? a : b)
 #define Max(a, b) ((a > b) ? a : b)
 
+/// Marks an entry of the SNR threshold tables that has not been computed yet
+/// (SNRs are in linear scale, hence strictly positive).
+static const double NO_SNR_THRESHOLD = -1;
+
+/// Initial size of the memory-mapped statistics file (grown by doubling)
+static const std::size_t STATS_FILE_INITIAL_SIZE = 1 << 20;
+
+/// Number of A-MPDU lengths (0 to RETRY_CACHE_AMPDU_LENS - 1 MPDUs) of the retry count cache.
+/// The retry counts of longer A-MPDUs are computed on every call.
+static const uint32_t RETRY_CACHE_AMPDU_LENS = 64;
+
+/// Samples per supported group and stats interval of the adaptive sampling: on
+/// stable links, by default, and after a node of the link started or stopped moving
+static const uint32_t SAMPLING_BUDGET_STABLE = 2;
+static const uint32_t SAMPLING_BUDGET_DEFAULT = 8;
+static const uint32_t SAMPLING_BUDGET_BOOST = 16;
+/// Stats intervals of boosted sampling after a node of the link started or stopped moving
+static const uint32_t SAMPLING_BOOST_INTERVALS = 10;
+/// Largest change of the predicted SNR over a stats interval on a stable link (dB)
+static const double SAMPLING_STABLE_SNR_DELTA = 1;
+/// Largest prediction error on a stable link
+static const double SAMPLING_STABLE_ERROR = 0.1;
+
+/// Variance of the SNR bias estimate of a new station (dB^2): a bias of a few
+/// dB is plausible before any acknowledgment
+static const double SNR_BIAS_INITIAL_VARIANCE = 25;
+
+/// Size of the MPDUs of each size class of the airtime tables (bytes): an MPDU
+/// is counted in the class of the closest size
+static const uint32_t MPDU_SIZE_CLASS_BYTES[ns3::TARA_MPDU_SIZE_CLASSES] = {256, 768, 1536, 2304};
+
+/**
+ * \param size the size of an MPDU (bytes)
+ * \returns the size class of the MPDU
+ */
+static uint8_t
+GetMpduSizeClass(uint32_t size)
+{
+    uint8_t c = 0;
+    while (c + 1 < ns3::TARA_MPDU_SIZE_CLASSES &&
+           2 * size > MPDU_SIZE_CLASS_BYTES[c] + MPDU_SIZE_CLASS_BYTES[c + 1])
+    {
+        c++;
+    }
+    return c;
+}
+
+/// Number of station slots per chunk of the station pool
+static const std::size_t STATION_POOL_CHUNK_SLOTS = 32;
+/// Alignment of the station pool slots and of the statistics arrays (bytes, a cache line)
+static const std::size_t STATION_POOL_ALIGNMENT = 64;
+
+/**
+ * Return the number of entries of the statistics arrays of a station: one per
+ * rate of all groups, padded so that every array is a whole number of cache
+ * lines (and of SIMD vectors).
+ *
+ * \param numGroups the number of groups
+ * \param numRates the number of rates per group
+ * \returns the number of entries
+ */
+static std::size_t
+GetStatsArraySize(uint8_t numGroups, uint8_t numRates)
+{
+    std::size_t size = static_cast<std::size_t>(numGroups) * numRates;
+    return (size + 15) & ~static_cast<std::size_t>(15);
+}
+
+/**
+ * Return the size of the statistics arrays of a station, dirty bitmap included.
+ *
+ * \param nRates the number of entries of the statistics arrays
+ * \returns the size of the arrays (bytes)
+ */
+static std::size_t
+GetStatsArraysSize(std::size_t nRates)
+{
+    return nRates * (5 * sizeof(double) + 2 * sizeof(uint64_t) + 3 * sizeof(uint32_t)) +
+           (nRates + 63) / 64 * sizeof(uint64_t);
+}
+
+/**
+ * Round a size up to a multiple of the station pool alignment.
+ *
+ * \param size the size (bytes)
+ * \returns the rounded size (bytes)
+ */
+static std::size_t
+AlignToPoolSlot(std::size_t size)
+{
+    return (size + STATION_POOL_ALIGNMENT - 1) & ~(STATION_POOL_ALIGNMENT - 1);
+}
+
 NS_LOG_COMPONENT_DEFINE("TARAWifiManager");
 
 namespace ns3
 {
 
-/// TARAWifiRemoteStation structure
-struct TARAWifiRemoteStation : MinstrelWifiRemoteStation
+/**
+ * Return the size of the statistics block of a station: the statistics arrays,
+ * followed by the table of groups and the rate tables of the groups.
+ *
+ * \param numGroups the number of groups
+ * \param numRates the number of rates per group
+ * \returns the size of the block (bytes)
+ */
+static std::size_t
+GetStatsBlockSize(uint8_t numGroups, uint8_t numRates)
+{
+    if (numGroups == 0)
+    {
+        return 0;
+    }
+    return GetStatsArraysSize(GetStatsArraySize(numGroups, numRates)) +
+           numGroups * sizeof(GroupInfo) +
+           static_cast<std::size_t>(numGroups) * numRates * sizeof(TARARateInfo);
+}
+
+static_assert(std::is_trivially_copyable<GroupInfo>::value &&
+                  std::is_trivially_copyable<TARARateInfo>::value,
+              "the group tables are stored in the raw statistics block of a station");
+static_assert(alignof(GroupInfo) <= alignof(uint64_t) &&
+                  alignof(TARARateInfo) <= alignof(GroupInfo),
+              "the group tables follow the dirty bitmap of the statistics block");
+static_assert(alignof(MinstrelWifiRemoteStation) <= STATION_POOL_ALIGNMENT,
+              "the legacy state of a non-HT station takes the place of its statistics block");
+
+/**
+ * Free-list pool of the remote stations of a TARAWifiManager. Each slot holds a
+ * header, the station and the statistics block of the station (or, for a non-HT
+ * station, its legacy Minstrel state), so that creating
+ * and deleting stations (association, reassociation, dispose) does not go
+ * through the general-purpose allocator once the pool has grown. Slots are
+ * allocated in chunks, which are released when both the manager and all its
+ * stations are gone (stations may be deleted by the base class after the
+ * manager members).
+ */
+class TARAStationPool
+{
+  public:
+    /**
+     * Create a pool of station slots.
+     *
+     * \param stationSize the size of a station object (bytes)
+     * \param statsSize the size of the statistics block of a station (bytes)
+     * \param legacySize the size of the legacy Minstrel state of a non-HT station (bytes)
+     */
+    TARAStationPool(std::size_t stationSize, std::size_t statsSize, std::size_t legacySize)
+        : m_stationSize(AlignToPoolSlot(stationSize)),
+          m_slotSize(STATION_POOL_ALIGNMENT + m_stationSize +
+                     AlignToPoolSlot(std::max(statsSize, legacySize))),
+          m_statsSize(statsSize),
+          m_freeSlots(nullptr),
+          m_nAllocated(0),
+          m_detached(false)
+    {
+    }
+
+    /**
+     * Take a slot from the pool, growing the pool if there is no free slot.
+     * The statistics block of the slot is zeroed.
+     *
+     * \returns the storage of the station
+     */
+    void* Allocate()
+    {
+        if (m_freeSlots == nullptr)
+        {
+            m_chunks.emplace_back(
+                new uint8_t[STATION_POOL_CHUNK_SLOTS * m_slotSize + STATION_POOL_ALIGNMENT]);
+            uintptr_t base = reinterpret_cast<uintptr_t>(m_chunks.back().get());
+            base = (base + STATION_POOL_ALIGNMENT - 1) & ~(STATION_POOL_ALIGNMENT - 1);
+            for (std::size_t i = STATION_POOL_CHUNK_SLOTS; i > 0; i--)
+            {
+                Slot* slot = reinterpret_cast<Slot*>(base + (i - 1) * m_slotSize);
+                slot->pool = this;
+                slot->inUse = false;
+                slot->nextFree = m_freeSlots;
+                m_freeSlots = slot;
+            }
+        }
+        Slot* slot = m_freeSlots;
+        m_freeSlots = slot->nextFree;
+        slot->inUse = true;
+        m_nAllocated++;
+        uint8_t* station = reinterpret_cast<uint8_t*>(slot) + STATION_POOL_ALIGNMENT;
+        std::memset(station + m_stationSize, 0, m_statsSize);
+        return station;
+    }
+
+    /**
+     * Return the slot of a station to its pool.
+     *
+     * \param station the storage of the station
+     */
+    static void Release(void* station)
+    {
+        Slot* slot = GetSlot(station);
+        TARAStationPool* pool = slot->pool;
+        slot->inUse = false;
+        slot->nextFree = pool->m_freeSlots;
+        pool->m_freeSlots = slot;
+        pool->m_nAllocated--;
+        if (pool->m_detached && pool->m_nAllocated == 0)
+        {
+            delete pool;
+        }
+    }
+
+    /**
+     * \returns the size of the statistics block of a station (bytes)
+     */
+    std::size_t GetStatsSize() const
+    {
+        return m_statsSize;
+    }
+
+    /**
+     * \param station the storage of the station
+     * \returns the statistics block of the station
+     */
+    uint8_t* GetStatsBlock(void* station) const
+    {
+        return m_statsSize > 0 ? static_cast<uint8_t*>(station) + m_stationSize : nullptr;
+    }
+
+    /**
+     * \param station the storage of the station
+     * \returns the storage of the legacy Minstrel state of the station, which
+     *          takes the place of its statistics block
+     */
+    void* GetLegacyStorage(void* station) const
+    {
+        return static_cast<uint8_t*>(station) + m_stationSize;
+    }
+
+    /**
+     * Call a function on each station of the pool, in memory order (the
+     * station and its statistics block are contiguous, so a walk over the pool
+     * streams through the statistics of all the stations). The function must
+     * not allocate or release stations.
+     *
+     * \param f the function, called with the storage of each station
+     */
+    template <typename F>
+    void ForEachStation(F f) const
+    {
+        for (const auto& chunk : m_chunks)
+        {
+            uintptr_t base = reinterpret_cast<uintptr_t>(chunk.get());
+            base = (base + STATION_POOL_ALIGNMENT - 1) & ~(STATION_POOL_ALIGNMENT - 1);
+            for (std::size_t i = 0; i < STATION_POOL_CHUNK_SLOTS; i++)
+            {
+                Slot* slot = reinterpret_cast<Slot*>(base + i * m_slotSize);
+                if (slot->inUse)
+                {
+                    f(reinterpret_cast<uint8_t*>(slot) + STATION_POOL_ALIGNMENT);
+                }
+            }
+        }
+    }
+
+    /**
+     * Called by the manager when it is destroyed: the pool deletes itself once
+     * all the stations have been released.
+     */
+    void Detach()
+    {
+        m_detached = true;
+        if (m_nAllocated == 0)
+        {
+            delete this;
+        }
+    }
+
+  private:
+    /// Header of a slot, before the station
+    struct Slot
+    {
+        TARAStationPool* pool; //!< The pool owning the slot.
+        Slot* nextFree;        //!< The next free slot (when the slot is free).
+        bool inUse;            //!< If the slot holds a station.
+    };
+
+    /**
+     * \param station the storage of the station
+     * \returns the header of the slot of the station
+     */
+    static Slot* GetSlot(void* station)
+    {
+        return reinterpret_cast<Slot*>(static_cast<uint8_t*>(station) - STATION_POOL_ALIGNMENT);
+    }
+
+    std::size_t m_stationSize;                        //!< Size of the station part of a slot.
+    std::size_t m_slotSize;                           //!< Size of a slot.
+    std::size_t m_statsSize;                          //!< Size of a statistics block.
+    std::vector<std::unique_ptr<uint8_t[]>> m_chunks; //!< The chunks of slots.
+    Slot* m_freeSlots;                                //!< Head of the free list.
+    std::size_t m_nAllocated;                         //!< Number of slots in use.
+    bool m_detached;                                  //!< If the manager is gone.
+};
+
+/**
+ * Appends TARAStatsRecord records to the binary statistics file. On POSIX
+ * systems the file is memory-mapped and grown by doubling its size, so that
+ * recording a statistics table is a few stores and no system call; the record
+ * count of the file header is kept up to date on every append, so that the
+ * file can be decoded even if the simulation does not terminate cleanly.
+ * Elsewhere the records go through a buffered stream.
+ */
+class TARAStatsRecorder
+{
+  public:
+    /**
+     * Create the statistics file, truncating any previous file.
+     *
+     * \param fileName the name of the file
+     */
+    TARAStatsRecorder(const std::string& fileName);
+    ~TARAStatsRecorder();
+
+    /**
+     * Append a record to the file.
+     *
+     * \param record the record
+     */
+    void Append(const TARAStatsRecord& record);
+
+  private:
+    std::string m_fileName; //!< Name of the file.
+    uint64_t m_nRecords;    //!< Number of records in the file.
+#ifdef TARA_STATS_MMAP
+    /**
+     * Map the file with the given size.
+     *
+     * \param size the size of the file (bytes)
+     */
+    void Map(std::size_t size);
+
+    int m_fd;           //!< File descriptor.
+    uint8_t* m_base;    //!< Mapping of the file.
+    std::size_t m_size; //!< Size of the file and mapping (bytes).
+#else
+    std::ofstream m_file; //!< The file stream.
+#endif
+};
+
+#ifdef TARA_STATS_MMAP
+TARAStatsRecorder::TARAStatsRecorder(const std::string& fileName)
+    : m_fileName(fileName),
+      m_nRecords(0),
+      m_fd(-1),
+      m_base(nullptr),
+      m_size(0)
+{
+    m_fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+    {
+        NS_FATAL_ERROR("Cannot open statistics file " << fileName);
+    }
+    Map(STATS_FILE_INITIAL_SIZE);
+    auto header = reinterpret_cast<TARAStatsFileHeader*>(m_base);
+    std::memcpy(header->magic, TARA_STATS_MAGIC, sizeof(header->magic));
+    header->version = TARA_STATS_VERSION;
+    header->recordSize = sizeof(TARAStatsRecord);
+    header->nRecords = 0;
+}
+
+TARAStatsRecorder::~TARAStatsRecorder()
+{
+    std::size_t used = sizeof(TARAStatsFileHeader) + m_nRecords * sizeof(TARAStatsRecord);
+    munmap(m_base, m_size);
+    if (ftruncate(m_fd, used) != 0)
+    {
+        NS_LOG_UNCOND("Cannot truncate statistics file " << m_fileName);
+    }
+    close(m_fd);
+}
+
+void
+TARAStatsRecorder::Map(std::size_t size)
+{
+    if (m_base != nullptr)
+    {
+        munmap(m_base, m_size);
+    }
+    if (ftruncate(m_fd, size) != 0)
+    {
+        NS_FATAL_ERROR("Cannot grow statistics file " << m_fileName);
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (base == MAP_FAILED)
+    {
+        NS_FATAL_ERROR("Cannot map statistics file " << m_fileName);
+    }
+    m_base = static_cast<uint8_t*>(base);
+    m_size = size;
+}
+
+void
+TARAStatsRecorder::Append(const TARAStatsRecord& record)
+{
+    std::size_t offset = sizeof(TARAStatsFileHeader) + m_nRecords * sizeof(TARAStatsRecord);
+    if (offset + sizeof(TARAStatsRecord) > m_size)
+    {
+        Map(2 * m_size);
+    }
+    std::memcpy(m_base + offset, &record, sizeof(TARAStatsRecord));
+    reinterpret_cast<TARAStatsFileHeader*>(m_base)->nRecords = ++m_nRecords;
+}
+#else
+TARAStatsRecorder::TARAStatsRecorder(const std::string& fileName)
+    : m_fileName(fileName),
+      m_nRecords(0),
+      m_file(fileName, std::ios::out | std::ios::binary | std::ios::trunc)
+{
+    if (!m_file)
+    {
+        NS_FATAL_ERROR("Cannot open statistics file " << fileName);
+    }
+    TARAStatsFileHeader header;
+    std::memcpy(header.magic, TARA_STATS_MAGIC, sizeof(header.magic));
+    header.version = TARA_STATS_VERSION;
+    header.recordSize = sizeof(TARAStatsRecord);
+    header.nRecords = 0;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+TARAStatsRecorder::~TARAStatsRecorder()
+{
+    m_file.seekp(offsetof(TARAStatsFileHeader, nRecords));
+    m_file.write(reinterpret_cast<const char*>(&m_nRecords), sizeof(m_nRecords));
+}
+
+void
+TARAStatsRecorder::Append(const TARAStatsRecord& record)
+{
+    m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    m_nRecords++;
+}
+#endif
+
+static const char SNR_CACHE_MAGIC[8] = {'T', 'A', 'R', 'A', 'S', 'N', 'R', 'C'}; //!< File magic
+static const uint32_t SNR_CACHE_VERSION = 2; //!< Version of the SNR cache file layout.
+
+/**
+ * What the SNR thresholds of a device depend on. Two devices with the same key
+ * have the same thresholds, so the key names the cache file and is checked
+ * when the file is loaded. The error rate model is identified by the SNRs it
+ * gives for the first non-HT mode and for the first and last MCSs of the
+ * device (three inversions of the model instead of one per mode, width and
+ * number of streams): models that share their non-HT curves, such as the
+ * TableBased model that falls back to the Nist model for the non-HT modes,
+ * differ on the MCSs.
+ */
+struct TARASnrCacheKey
+{
+    uint32_t standard;      //!< WifiStandard of the PHY.
+    uint32_t band;          //!< WifiPhyBand of the PHY.
+    uint16_t channelWidth;  //!< Channel width of the PHY (MHz).
+    uint16_t heGi;          //!< HE guard interval of the device (ns), 0 if HE is not supported.
+    uint8_t maxNss;         //!< Maximum number of spatial streams of the PHY.
+    uint8_t shortGi;        //!< If the device supports the HT/VHT short guard interval.
+    uint8_t htSupported;    //!< If the device supports HT.
+    uint8_t reserved;       //!< Padding, set to 0.
+    uint32_t nModes;        //!< Number of non-HT modes of the PHY.
+    uint32_t nMcs;          //!< Number of MCSs of the PHY.
+    double ber;             //!< BER threshold.
+    double probeSnr;        //!< SNR of the first mode of the PHY at the BER threshold.
+    double probeMcsSnr[2];  //!< SNRs of the first and last MCSs of the PHY at the BER threshold.
+};
+
+/**
+ * Header of an SNR cache file. It is followed by the dense SNR threshold table
+ * (SNR_TABLE_SIZE doubles) and by the SNR thresholds of the non-HT modes, in
+ * the order of the PHY mode list (nModes doubles).
+ */
+struct TARASnrCacheHeader
+{
+    char magic[8];       //!< SNR_CACHE_MAGIC.
+    uint32_t version;    //!< SNR_CACHE_VERSION.
+    uint32_t tableSize;  //!< SNR_TABLE_SIZE.
+    TARASnrCacheKey key; //!< What the thresholds depend on.
+    uint64_t checksum;   //!< FNV-1a hash of the thresholds.
+};
+
+/**
+ * 64-bit FNV-1a hash.
+ *
+ * \param data the data
+ * \param size the size of the data (bytes)
+ * \param hash the hash of the preceding data
+ * \returns the hash
+ */
+static uint64_t
+HashFnv1a(const void* data, std::size_t size, uint64_t hash = 0xcbf29ce484222325)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * TARAWifiRemoteStation structure. It carries the Minstrel fields used by the
+ * HT rate control only: the state of the legacy Minstrel rate control of
+ * non-HT stations (rate table, sample table and statistics file) is kept in a
+ * MinstrelWifiRemoteStation constructed for those stations only, in the slot of
+ * the station pool where HT stations have their statistics block.
+ */
+struct TARAWifiRemoteStation : WifiRemoteStation
 {
+    ~TARAWifiRemoteStation() override
+    {
+        if (m_legacyStation != nullptr)
+        {
+            m_legacyStation->~MinstrelWifiRemoteStation();
+        }
+    }
+
+    /**
+     * Allocate a station from the station pool of its manager.
+     *
+     * \param size the size of the station
+     * \param pool the station pool
+     * \returns the storage of the station
+     */
+    static void* operator new(std::size_t size, TARAStationPool* pool)
+    {
+        return pool->Allocate();
+    }
+
+    /**
+     * Return the station to its pool if its constructor throws.
+     *
+     * \param p the storage of the station
+     * \param pool the station pool
+     */
+    static void operator delete(void* p, TARAStationPool* pool)
+    {
+        TARAStationPool::Release(p);
+    }
+
+    /**
+     * Return the station to its pool when it is deleted.
+     *
+     * \param p the storage of the station
+     */
+    static void operator delete(void* p)
+    {
+        TARAStationPool::Release(p);
+    }
+
+    Time m_nextStatsUpdate; //!< Time when the stats will be updated.
+    uint8_t m_col;          //!< Sample table column.
+    uint8_t m_index;        //!< Sample table index.
+    uint16_t m_maxTpRate;   //!< The current throughput rate.
+    uint16_t m_maxTpRate2;  //!< The second highest throughput rate.
+    uint16_t m_maxProbRate; //!< The rate with the highest probability of success.
+    uint8_t m_nModes;       //!< Number of modes supported.
+    int m_totalPacketsCount;  //!< Total number of packets as of now.
+    int m_samplePacketsCount; //!< How many packets we have sample so far.
+    bool m_isSampling;        //!< A flag to indicate we are currently sampling.
+    uint16_t m_sampleRate;    //!< The current sample rate.
+    bool m_sampleDeferred;    //!< A flag to indicate sample rate is on the second stage.
+    uint32_t m_shortRetry;    //!< Short retries such as control packets.
+    uint32_t m_longRetry;     //!< Long retries such as data packets.
+    uint16_t m_txrate;        //!< Current transmit rate.
+    bool m_initialized;       //!< For initializing variables.
+
+    MinstrelWifiRemoteStation* m_legacyStation; //!< Legacy Minstrel state of a non-HT station
+                                                //!< (nullptr for HT stations).
+
     uint8_t m_sampleGroup; //!< The group that the sample rate belongs to.
 
     uint32_t m_sampleWait;     //!< How many transmission attempts to wait until a new sample.
@@ -66,12 +682,109 @@ struct TARAWifiRemoteStation : MinstrelWifiRemoteStation
     uint32_t m_ampduLen;         //!< Number of MPDUs in an A-MPDU.
     uint32_t m_ampduPacketCount; //!< Number of A-MPDUs transmitted.
 
-    McsGroupData m_groupsTable; //!< Table of groups with stats.
+    GroupInfo* m_groupsTable;   //!< Table of groups with stats (in the statistics block).
+    TARARateStats m_stats;      //!< Per-rate statistics (structure of arrays).
     bool m_isHt;                //!< If the station is HT capable.
 
-    std::ofstream m_statsFile; //!< File where statistics table is written.
+    TARATrajectory* m_trajectory; //!< Predicted trajectories of the link with this peer.
+    uint16_t m_taraRate;            //!< The TARA Algorithm current rate prediction (global index).
+    double m_predictionError; //!< EWMA of the failure ratio of the TARA rate (0 to 1): how
+                              //!< optimistic the SNR prediction of this peer has been.
+    bool m_moving;            //!< If a node of the link was moving at the last stats update.
+    uint32_t m_samplingBoost; //!< Remaining stats intervals of boosted sampling.
+    double m_lastPredictedSnr; //!< Predicted SNR at the last stats update (dB).
+    Time* m_samplingAirtime;   //!< Airtime spent sampling with this peer.
+    uint32_t m_retries;        //!< Number of retransmissions to this peer.
+    uint32_t m_dropped;        //!< Number of frames to this peer dropped after the last retry.
+    double m_snrBias;          //!< Estimated bias of the SNR model for this peer (dB).
+    TARAMpduSizes* m_mpduSizes; //!< MPDUs sent to this peer by size class (\see NotifyMpduSize).
+    std::array<double, TARA_MPDU_SIZE_CLASSES> m_sizeWeights; //!< EWMA of the share of the
+                                                              //!< MPDUs in each size class
+                                                              //!< (all 0 until MPDUs are seen)
+    double m_snrBiasVariance;  //!< Variance of the SNR bias estimate (dB^2).
+    bool m_taraMaxTp;          //!< If the max throughput rate was set by the TARA prediction.
+    uint16_t m_lastDecision;   //!< The rate of the last rate decision.
+    uint8_t m_powerLevel;      //!< Power level of the last data frame to this peer.
+    double m_powerSnr;         //!< Lowest SNR predicted at the maximum power until the next
+                               //!< stats update (dB), -inf if the power must not be reduced.
+    Time m_lastDecisionChange; //!< When the rate of the decisions last changed.
+
+    uint32_t m_statsUpdates; //!< Number of stats updates so far.
 };
 
+/**
+ * Lay out the statistics arrays of a station in its statistics block.
+ *
+ * \param block the statistics block (aligned, zeroed), nullptr if none
+ * \param blockSize the size of the statistics block (bytes)
+ * \param numGroups the number of groups
+ * \param numRates the number of rates per group
+ * \returns the statistics arrays
+ */
+static TARARateStats
+CarveRateStats(uint8_t* block, std::size_t blockSize, uint8_t numGroups, uint8_t numRates)
+{
+    NS_ASSERT_MSG(blockSize == GetStatsBlockSize(numGroups, numRates),
+                  "The station pool was sized for other groups than those of the manager");
+    TARARateStats stats = {};
+    if (block == nullptr)
+    {
+        // Not initialized as an HT manager: only legacy Minstrel is used
+        return stats;
+    }
+
+    std::size_t nRates = GetStatsArraySize(numGroups, numRates);
+    // Widest types first to keep every array aligned
+    stats.prob = reinterpret_cast<double*>(block);
+    stats.ewmaProb = stats.prob + nRates;
+    stats.ewmsdProb = stats.ewmaProb + nRates;
+    stats.throughput = stats.ewmsdProb + nRates;
+    stats.txTime = stats.throughput + nRates;
+    stats.successHist = reinterpret_cast<uint64_t*>(stats.txTime + nRates);
+    stats.attemptHist = stats.successHist + nRates;
+    stats.numRateAttempt = reinterpret_cast<uint32_t*>(stats.attemptHist + nRates);
+    stats.numRateSuccess = stats.numRateAttempt + nRates;
+    stats.supported = stats.numRateSuccess + nRates;
+    stats.dirty = reinterpret_cast<uint64_t*>(stats.supported + nRates);
+    return stats;
+}
+
+/**
+ * Lay out the table of groups of a station, and the rate tables of the groups,
+ * after the statistics arrays of its statistics block. Every group and rate
+ * entry is reset.
+ *
+ * \param block the statistics block
+ * \param numGroups the number of groups
+ * \param numRates the number of rates per group
+ * \returns the table of groups
+ */
+static GroupInfo*
+CarveGroupsTable(uint8_t* block, uint8_t numGroups, uint8_t numRates)
+{
+    NS_ASSERT(block != nullptr);
+    uint8_t* p = block + GetStatsArraysSize(GetStatsArraySize(numGroups, numRates));
+    GroupInfo* groups = new (p) GroupInfo[numGroups]();
+    TARARateInfo* rates = new (groups + numGroups) TARARateInfo[numGroups * numRates]();
+    for (uint8_t groupId = 0; groupId < numGroups; groupId++)
+    {
+        groups[groupId].m_ratesTable = rates + groupId * numRates;
+    }
+    return groups;
+}
+
+/**
+ * Mark a rate as attempted since the last statistics update.
+ *
+ * \param stats the statistics arrays of the station
+ * \param index the global rate index
+ */
+static inline void
+SetRateDirty(const TARARateStats& stats, uint16_t index)
+{
+    stats.dirty[index / 64] |= static_cast<uint64_t>(1) << (index % 64);
+}
+
 NS_OBJECT_ENSURE_REGISTERED(TARAWifiManager);
 
 TypeId
@@ -87,6 +800,13 @@ TARAWifiManager::GetTypeId()
                           TimeValue(MilliSeconds(50)),
                           MakeTimeAccessor(&TARAWifiManager::m_updateStats),
                           MakeTimeChecker())
+            .AddAttribute("BatchedStatsUpdate",
+                          "Update the statistics of all the HT stations due in an "
+                          "UpdateStatistics period from a periodic event of the manager, "
+                          "instead of from the feedback of each frame",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_batchedStats),
+                          MakeBooleanChecker())
             .AddAttribute("LegacyUpdateStatistics",
                           "The interval between updating statistics table (for legacy Minstrel)",
                           TimeValue(MilliSeconds(100)),
@@ -118,25 +838,114 @@ TARAWifiManager::GetTypeId()
                           MakeBooleanAccessor(&TARAWifiManager::m_useLatestAmendmentOnly),
                           MakeBooleanChecker())
             .AddAttribute("PrintStats",
-                          "Control the printing of the statistics table",
+                          "Control the recording of the statistics tables in a binary file (decoded "
+                          "with tools/tara-stats-decode)",
                           BooleanValue(false),
                           MakeBooleanAccessor(&TARAWifiManager::m_printStats),
                           MakeBooleanChecker())
-            .AddAttribute("TARARate",
-                          "The TARA Algorithm current MCS prediction (MCS id)",
-                          UintegerValue(0),
-                          MakeUintegerAccessor(&TARAWifiManager::m_TARARate),
-                          MakeUintegerChecker<uint16_t>())
+            .AddAttribute("PredictionBlending",
+                          "Weight the TARA rate against the Minstrel best rates by the confidence "
+                          "in the SNR prediction of each peer, instead of always preferring it "
+                          "when it is faster",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_predictionBlending),
+                          MakeBooleanChecker())
+            .AddAttribute("AdaptiveSampling",
+                          "Adapt the number of look-around samples of each peer to the TARA "
+                          "prediction: fewer on stable, well predicted links, more after a node "
+                          "of the link starts or stops moving",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_adaptiveSampling),
+                          MakeBooleanChecker())
             .AddAttribute("TARASnr",
-                          "The TARA Algorithm current SNR prediction (MCS id)",
+                          "The TARA Algorithm SNR prediction (dB) of the peers for which no "
+                          "trajectory was set with SetTrajectory",
                           DoubleValue(0),
                           MakeDoubleAccessor(&TARAWifiManager::m_TARASnr),
                           MakeDoubleChecker<double>())
+            .AddAttribute("SnrCacheDirectory",
+                          "Directory of the cache files of the SNR thresholds of the modes, "
+                          "shared by the simulations of a sweep (no cache if empty)",
+                          StringValue(""),
+                          MakeStringAccessor(&TARAWifiManager::m_snrCacheDirectory),
+                          MakeStringChecker())
+            .AddAttribute("SnrBiasCorrection",
+                          "Learn the bias of the SNR prediction of each peer from the SNR of "
+                          "the data frames reported in the acknowledgments, and correct the "
+                          "prediction with it",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_snrBiasCorrection),
+                          MakeBooleanChecker())
+            .AddAttribute("SnrBiasProcessNoise",
+                          "Variance (dB^2) of the change of the SNR bias between two "
+                          "acknowledgments",
+                          DoubleValue(0.05),
+                          MakeDoubleAccessor(&TARAWifiManager::m_snrBiasProcessNoise),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("SnrBiasMeasurementNoise",
+                          "Variance (dB^2) of the SNR reported in an acknowledgment around the "
+                          "biased prediction (fading, interference)",
+                          DoubleValue(4),
+                          MakeDoubleAccessor(&TARAWifiManager::m_snrBiasMeasurementNoise),
+                          MakeDoubleChecker<double>(0))
             .AddAttribute("BerThreshold",
                           "The maximum Bit Error Rate acceptable at any transmission mode",
                           DoubleValue(1e-6),
                           MakeDoubleAccessor(&TARAWifiManager::m_ber),
                           MakeDoubleChecker<double>())
+            .AddAttribute("PredictiveRetry",
+                          "Take the fallback rate of the retry chain from the SNR predicted "
+                          "RetryLookahead ahead along the trajectory: lower and sooner on "
+                          "receding links, higher on approaching ones",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_predictiveRetry),
+                          MakeBooleanChecker())
+            .AddAttribute("RetryLookahead",
+                          "How far ahead along the trajectory the retry chain is predicted",
+                          TimeValue(MilliSeconds(300)),
+                          MakeTimeAccessor(&TARAWifiManager::m_retryLookahead),
+                          MakeTimeChecker())
+            .AddAttribute("WidthLookahead",
+                          "How far ahead along the trajectory the SNR must sustain a rate of a "
+                          "channel wider than 20 MHz for the TARA rate: the TARA rate falls back "
+                          "to a narrower channel before a predicted fade",
+                          TimeValue(MilliSeconds(300)),
+                          MakeTimeAccessor(&TARAWifiManager::m_widthLookahead),
+                          MakeTimeChecker())
+            .AddAttribute("PowerControl",
+                          "Transmit the data frames of peers with a trajectory at the lowest "
+                          "power level that keeps the SNR predicted until the next stats update "
+                          "PowerMargin above the minimum SNR of their rate. The SNR model "
+                          "predicts the SNR at the maximum power level of the PHY",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TARAWifiManager::m_powerControl),
+                          MakeBooleanChecker())
+            .AddAttribute("PowerMargin",
+                          "Margin (dB) kept above the minimum SNR of the rate when the "
+                          "transmit power is reduced",
+                          DoubleValue(3),
+                          MakeDoubleAccessor(&TARAWifiManager::m_powerMargin),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("TraceEvents",
+                          "Number of rate-control decisions kept in the tracepoint ring of the "
+                          "manager (0 disables the tracepoints), written by DumpTracepoints",
+                          UintegerValue(1024),
+                          MakeUintegerAccessor(&TARAWifiManager::m_traceEvents),
+                          MakeUintegerChecker<uint32_t>())
+            .AddTraceSource("RetryStats",
+                            "The retransmission and dropped frame counts of a remote station, "
+                            "on every retransmission or drop",
+                            MakeTraceSourceAccessor(&TARAWifiManager::m_retryStatsTrace),
+                            "ns3::TARAWifiManager::RetryStatsTracedCallback")
+            .AddTraceSource("RateDecision",
+                            "The provenance of every rate decision: station, rate, reason, "
+                            "predicted SNR, EWMA probability and time since the last change",
+                            MakeTraceSourceAccessor(&TARAWifiManager::m_rateDecisionTrace),
+                            "ns3::TARAWifiManager::RateDecisionTracedCallback")
+            .AddTraceSource("PowerChange",
+                            "The transmit power of the data frames to a remote station changed",
+                            MakeTraceSourceAccessor(&TARAWifiManager::m_powerChangeTrace),
+                            "ns3::WifiRemoteStationManager::PowerChangeTracedCallback")
             .AddTraceSource("Rate",
                             "Traced value for rate changes (b/s)",
                             MakeTraceSourceAccessor(&TARAWifiManager::m_currentRate),
@@ -147,9 +956,15 @@ TARAWifiManager::GetTypeId()
 TARAWifiManager::TARAWifiManager()
     : m_numGroups(0),
       m_numRates(0),
+      m_maxPowerLevel(0),
+      m_powerStep(0),
+      m_stationPool(nullptr),
+      m_traceCount(0),
+      m_lastMpduSizes(nullptr),
       m_currentRate(0)
 {
     NS_LOG_FUNCTION(this);
+    m_decisionCounts.fill(0);
     m_uniformRandomVariable = CreateObject<UniformRandomVariable>();
     /**
      *  Create the legacy Minstrel manager in case HT is not supported by the device
@@ -161,10 +976,9 @@ TARAWifiManager::TARAWifiManager()
 TARAWifiManager::~TARAWifiManager()
 {
     NS_LOG_FUNCTION(this);
-    for (uint8_t i = 0; i < m_numGroups; i++)
+    if (m_stationPool != nullptr)
     {
-        m_minstrelGroups[i].ratesFirstMpduTxTimeTable.clear();
-        m_minstrelGroups[i].ratesTxTimeTable.clear();
+        m_stationPool->Detach();
     }
 }
 
@@ -186,6 +1000,7 @@ TARAWifiManager::SetupPhy(const Ptr<WifiPhy> phy)
     // Setup PHY for legacy manager.
     m_legacyManager->SetupPhy(phy);
     WifiRemoteStationManager::SetupPhy(phy);
+    m_retryCountCache.clear();
 }
 
 void
@@ -194,6 +1009,19 @@ TARAWifiManager::SetupMac(const Ptr<WifiMac> mac)
     NS_LOG_FUNCTION(this << mac);
     m_legacyManager->SetupMac(mac);
     WifiRemoteStationManager::SetupMac(mac);
+    m_retryCountCache.clear();
+    mac->TraceConnectWithoutContext("AckedMpdu",
+                                    MakeCallback(&TARAWifiManager::NotifyMpduSize, this));
+    mac->TraceConnectWithoutContext("NAckedMpdu",
+                                    MakeCallback(&TARAWifiManager::NotifyMpduSize, this));
+}
+
+void
+TARAWifiManager::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    m_statsEvent.Cancel();
+    WifiRemoteStationManager::DoDispose();
 }
 
 void
@@ -201,7 +1029,27 @@ TARAWifiManager::DoInitialize()
 {
     NS_LOG_FUNCTION(this);
     
+    // Configure the legacy Minstrel of non-HT stations once, rather than on each association
+    m_legacyManager->SetAttribute("UpdateStatistics", TimeValue(m_legacyUpdateStats));
+    m_legacyManager->SetAttribute("LookAroundRate", UintegerValue(m_lookAroundRate));
+    m_legacyManager->SetAttribute("EWMA", UintegerValue(m_ewmaLevel));
+    m_legacyManager->SetAttribute("SampleColumn", UintegerValue(m_nSampleCol));
+    m_legacyManager->SetAttribute("PacketLength", UintegerValue(m_frameLength));
+    m_legacyManager->SetAttribute("PrintStats", BooleanValue(m_printStats));
     BuildSnrThresholds();
+    m_traceRing.assign(m_traceEvents, TARATraceEvent());
+    m_traceCount = 0;
+    m_maxPowerLevel = GetPhy()->GetNTxPower() - 1;
+    m_powerStep =
+        m_maxPowerLevel > 0
+            ? (GetPhy()->GetTxPowerEnd() - GetPhy()->GetTxPowerStart()) / m_maxPowerLevel
+            : 0;
+
+    if (m_batchedStats && m_updateStats.IsStrictlyPositive())
+    {
+        m_statsEvent =
+            Simulator::Schedule(m_updateStats, &TARAWifiManager::UpdateDueStats, this);
+    }
     
     /**
      * Here we initialize m_minstrelGroups with all the possible groups.
@@ -239,6 +1087,11 @@ TARAWifiManager::DoInitialize()
          */
         NS_LOG_DEBUG("Initialize MCS Groups:");
         m_minstrelGroups = MinstrelMcsGroups(m_numGroups);
+        m_ratesTxTimeTable.fill(Time());
+        m_ratesFirstMpduTxTimeTable.fill(Time());
+        m_sizeClassFirstTxTime.assign(
+            TARA_MPDU_SIZE_CLASSES * GetStatsArraySize(m_numGroups, m_numRates), 0);
+        m_sizeClassTxTime.assign(m_sizeClassFirstTxTime.size(), 0);
 
         // Initialize all HT groups
         for (uint16_t chWidth = 20; chWidth <= MAX_HT_WIDTH; chWidth *= 2)
@@ -272,7 +1125,7 @@ TARAWifiManager::DoInitialize()
                             uint16_t deviceIndex = i + (m_minstrelGroups[groupId].streams - 1) * 8;
                             WifiMode mode = htMcsList[deviceIndex];
                             AddFirstMpduTxTime(groupId,
-                                               mode,
+                                               i,
                                                CalculateMpduTxDuration(GetPhy(),
                                                                        streams,
                                                                        gi,
@@ -280,13 +1133,14 @@ TARAWifiManager::DoInitialize()
                                                                        mode,
                                                                        FIRST_MPDU_IN_AGGREGATE));
                             AddMpduTxTime(groupId,
-                                          mode,
+                                          i,
                                           CalculateMpduTxDuration(GetPhy(),
                                                                   streams,
                                                                   gi,
                                                                   chWidth,
                                                                   mode,
                                                                   MIDDLE_MPDU_IN_AGGREGATE));
+                            AddSizeClassTxTimes(groupId, i, mode);
                         }
                         NS_LOG_DEBUG("Initialized group " << +groupId << ": (" << +streams << ","
                                                           << gi << "," << chWidth << ")");
@@ -333,7 +1187,7 @@ TARAWifiManager::DoInitialize()
                                 {
                                     AddFirstMpduTxTime(
                                         groupId,
-                                        mode,
+                                        i,
                                         CalculateMpduTxDuration(GetPhy(),
                                                                 streams,
                                                                 gi,
@@ -342,13 +1196,14 @@ TARAWifiManager::DoInitialize()
                                                                 FIRST_MPDU_IN_AGGREGATE));
                                     AddMpduTxTime(
                                         groupId,
-                                        mode,
+                                        i,
                                         CalculateMpduTxDuration(GetPhy(),
                                                                 streams,
                                                                 gi,
                                                                 chWidth,
                                                                 mode,
                                                                 MIDDLE_MPDU_IN_AGGREGATE));
+                                    AddSizeClassTxTimes(groupId, i, mode);
                                 }
                             }
                             NS_LOG_DEBUG("Initialized group " << +groupId << ": (" << +streams
@@ -397,7 +1252,7 @@ TARAWifiManager::DoInitialize()
                                 {
                                     AddFirstMpduTxTime(
                                         groupId,
-                                        mode,
+                                        i,
                                         CalculateMpduTxDuration(GetPhy(),
                                                                 streams,
                                                                 gi,
@@ -406,13 +1261,14 @@ TARAWifiManager::DoInitialize()
                                                                 FIRST_MPDU_IN_AGGREGATE));
                                     AddMpduTxTime(
                                         groupId,
-                                        mode,
+                                        i,
                                         CalculateMpduTxDuration(GetPhy(),
                                                                 streams,
                                                                 gi,
                                                                 chWidth,
                                                                 mode,
                                                                 MIDDLE_MPDU_IN_AGGREGATE));
+                                    AddSizeClassTxTimes(groupId, i, mode);
                                 }
                             }
                             NS_LOG_DEBUG("Initialized group " << +groupId << ": (" << +streams
@@ -424,7 +1280,22 @@ TARAWifiManager::DoInitialize()
                 }
             }
         }
+
+        // Transmit times in seconds, as read by the statistics update kernel
+        m_ratesPerfectTxTime.assign(GetStatsArraySize(m_numGroups, m_numRates), 0);
+        for (uint16_t index = 0; index < m_numGroups * m_numRates; index++)
+        {
+            m_ratesPerfectTxTime[index] = m_ratesFirstMpduTxTimeTable[index].GetSeconds();
+        }
+        m_retryCountCache.clear();
+        BuildGroupSnrThresholds();
     }
+
+    // The statistics block of the stations depends on the groups of the device
+    NS_ASSERT(m_stationPool == nullptr);
+    m_stationPool = new TARAStationPool(sizeof(TARAWifiRemoteStation),
+                                        GetStatsBlockSize(m_numGroups, m_numRates),
+                                        sizeof(MinstrelWifiRemoteStation));
 }
 
 uint16_t
@@ -448,7 +1319,24 @@ TARAWifiManager::GetChannelWidthForNonHtMode(WifiMode mode) const
 void
 TARAWifiManager::BuildSnrThresholds()
 {
-    m_thresholds.clear();
+    m_snrThresholds.fill(NO_SNR_THRESHOLD);
+    m_legacySnrThresholds.clear();
+
+    std::string cacheFile;
+    TARASnrCacheKey key;
+    if (!m_snrCacheDirectory.empty())
+    {
+        key = GetSnrCacheKey();
+        std::ostringstream name;
+        name << m_snrCacheDirectory << "/tara-snr-" << std::hex
+             << HashFnv1a(&key, sizeof(key)) << ".bin";
+        cacheFile = name.str();
+        if (LoadSnrThresholds(cacheFile, key))
+        {
+            return;
+        }
+    }
+
     WifiMode mode;
     WifiTxVector txVector;
     uint8_t nss = 1;
@@ -512,43 +1400,338 @@ TARAWifiManager::BuildSnrThresholds()
             }
         }
     }
+    if (!cacheFile.empty())
+    {
+        SaveSnrThresholds(cacheFile, key);
+    }
 }
 
-double
-TARAWifiManager::GetSnrThreshold(WifiTxVector txVector)
+TARASnrCacheKey
+TARAWifiManager::GetSnrCacheKey()
 {
-    NS_LOG_FUNCTION(this << txVector);
-    auto it = std::find_if(m_thresholds.begin(),
-                           m_thresholds.end(),
-                           [&txVector](const std::pair<double, WifiTxVector>& p) -> bool {
-                               return ((txVector.GetMode() == p.second.GetMode()) &&
-                                       (txVector.GetNss() == p.second.GetNss()) &&
-                                       (txVector.GetChannelWidth() == p.second.GetChannelWidth()));
-                           });
-    if (it == m_thresholds.end())
-    {
-        // This means capabilities have changed in runtime, hence rebuild SNR thresholds
-        BuildSnrThresholds();
-        it = std::find_if(m_thresholds.begin(),
-                          m_thresholds.end(),
-                          [&txVector](const std::pair<double, WifiTxVector>& p) -> bool {
-                              return ((txVector.GetMode() == p.second.GetMode()) &&
-                                      (txVector.GetNss() == p.second.GetNss()) &&
-                                      (txVector.GetChannelWidth() == p.second.GetChannelWidth()));
-                          });
-        NS_ASSERT_MSG(it != m_thresholds.end(), "SNR threshold not found");
-    }
-    return it->first;
-}
-
-void
-TARAWifiManager::AddSnrThreshold(WifiTxVector txVector, double snr)
+    NS_LOG_FUNCTION(this);
+    TARASnrCacheKey key;
+    std::memset(&key, 0, sizeof(key));
+    Ptr<WifiPhy> phy = GetPhy();
+    key.standard = phy->GetStandard();
+    key.band = phy->GetPhyBand();
+    key.channelWidth = phy->GetChannelWidth();
+    key.heGi = GetHeSupported() ? GetGuardInterval() : 0;
+    key.maxNss = phy->GetMaxSupportedTxSpatialStreams();
+    key.shortGi = GetShortGuardIntervalSupported();
+    key.htSupported = GetHtSupported();
+    key.nModes = phy->GetModeList().size();
+    key.nMcs = phy->GetMcsList().size();
+    key.ber = m_ber;
+    WifiMode mode = phy->GetModeList().front();
+    WifiTxVector txVector;
+    txVector.SetChannelWidth(GetChannelWidthForNonHtMode(mode));
+    txVector.SetNss(1);
+    txVector.SetMode(mode);
+    key.probeSnr = phy->CalculateSnr(txVector, m_ber);
+    if (key.htSupported && key.nMcs > 0)
+    {
+        // Same guard interval and number of streams as BuildSnrThresholds, one stream for VHT/HE
+        const WifiMode mcs[2] = {phy->GetMcsList().front(), phy->GetMcsList().back()};
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            WifiModulationClass modulationClass = mcs[i].GetModulationClass();
+            uint8_t nss = modulationClass == WIFI_MOD_CLASS_HT ? mcs[i].GetMcsValue() / 8 + 1 : 1;
+            if (!mcs[i].IsAllowed(key.channelWidth, nss))
+            {
+                continue;
+            }
+            txVector.SetChannelWidth(key.channelWidth);
+            txVector.SetGuardInterval(modulationClass == WIFI_MOD_CLASS_HE
+                                          ? GetGuardInterval()
+                                          : (key.shortGi ? 400 : 800));
+            txVector.SetNss(nss);
+            txVector.SetMode(mcs[i]);
+            key.probeMcsSnr[i] = phy->CalculateSnr(txVector, m_ber);
+        }
+    }
+    return key;
+}
+
+bool
+TARAWifiManager::LoadSnrThresholds(const std::string& fileName, const TARASnrCacheKey& key)
+{
+    NS_LOG_FUNCTION(this << fileName);
+    std::size_t tableBytes = SNR_TABLE_SIZE * sizeof(double);
+    std::size_t size = sizeof(TARASnrCacheHeader) + tableBytes + key.nModes * sizeof(double);
+#ifdef TARA_STATS_MMAP
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) != size)
+    {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+    const uint8_t* data = static_cast<const uint8_t*>(base);
+#else
+    std::ifstream in(fileName, std::ios::in | std::ios::binary);
+    std::vector<uint8_t> buffer(size + 1);
+    if (!in || !in.read(reinterpret_cast<char*>(buffer.data()), buffer.size()).eof() ||
+        static_cast<std::size_t>(in.gcount()) != size)
+    {
+        return false;
+    }
+    const uint8_t* data = buffer.data();
+#endif
+    TARASnrCacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const uint8_t* thresholds = data + sizeof(header);
+    bool valid = std::memcmp(header.magic, SNR_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SNR_CACHE_VERSION && header.tableSize == SNR_TABLE_SIZE &&
+                 std::memcmp(&header.key, &key, sizeof(key)) == 0 &&
+                 header.checksum == HashFnv1a(thresholds, size - sizeof(header));
+    if (valid)
+    {
+        std::memcpy(m_snrThresholds.data(), thresholds, tableBytes);
+        WifiTxVector txVector;
+        txVector.SetNss(1);
+        uint32_t i = 0;
+        for (const auto& mode : GetPhy()->GetModeList())
+        {
+            txVector.SetMode(mode);
+            std::memcpy(GetSnrThresholdEntry(txVector),
+                        thresholds + tableBytes + i++ * sizeof(double),
+                        sizeof(double));
+        }
+    }
+    else
+    {
+        NS_LOG_DEBUG("Invalid SNR cache file " << fileName);
+    }
+#ifdef TARA_STATS_MMAP
+    munmap(base, size);
+#endif
+    return valid;
+}
+
+void
+TARAWifiManager::SaveSnrThresholds(const std::string& fileName, const TARASnrCacheKey& key)
+{
+    NS_LOG_FUNCTION(this << fileName);
+    std::vector<double> legacy;
+    WifiTxVector txVector;
+    txVector.SetNss(1);
+    for (const auto& mode : GetPhy()->GetModeList())
+    {
+        txVector.SetMode(mode);
+        legacy.push_back(*GetSnrThresholdEntry(txVector));
+    }
+    TARASnrCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNR_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SNR_CACHE_VERSION;
+    header.tableSize = SNR_TABLE_SIZE;
+    header.key = key;
+    header.checksum = HashFnv1a(legacy.data(),
+                                legacy.size() * sizeof(double),
+                                HashFnv1a(m_snrThresholds.data(), SNR_TABLE_SIZE * sizeof(double)));
+
+    // Simulations of a sweep may share the directory: write a private file and
+    // rename it, so that a cache file is never seen partially written
+#ifdef TARA_STATS_MMAP
+    std::string tmpName = fileName + ".XXXXXX";
+    int fd = mkstemp(&tmpName[0]);
+    if (fd < 0)
+    {
+        NS_LOG_UNCOND("Cannot write SNR cache file " << fileName);
+        return;
+    }
+    // mkstemp creates the file readable by its owner only
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    close(fd);
+#else
+    std::ostringstream tmp;
+    tmp << fileName << "." << this << ".tmp";
+    std::string tmpName = tmp.str();
+#endif
+    {
+        std::ofstream out(tmpName, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(m_snrThresholds.data()),
+                  SNR_TABLE_SIZE * sizeof(double));
+        out.write(reinterpret_cast<const char*>(legacy.data()), legacy.size() * sizeof(double));
+        if (!out)
+        {
+            NS_LOG_UNCOND("Cannot write SNR cache file " << tmpName);
+            std::remove(tmpName.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpName.c_str(), fileName.c_str()) != 0)
+    {
+        NS_LOG_UNCOND("Cannot write SNR cache file " << fileName);
+        std::remove(tmpName.c_str());
+    }
+}
+
+void
+TARAWifiManager::BuildGroupSnrThresholds()
+{
+    NS_LOG_FUNCTION(this);
+    m_groupSnrThresholds.assign(m_numGroups * m_numRates, 0);
+    m_groupSnrRates.assign(m_numGroups * m_numRates, 0);
+    m_groupSnrCounts.assign(m_numGroups, 0);
+    m_rateSnrThresholds.assign(m_numGroups * m_numRates, std::numeric_limits<double>::infinity());
+    for (uint8_t groupId = 0; groupId < m_numGroups; groupId++)
+    {
+        const McsGroup& group = m_minstrelGroups[groupId];
+        if (!group.isSupported)
+        {
+            continue;
+        }
+        WifiModeList mcsList;
+        switch (group.type)
+        {
+        case WIFI_MINSTREL_GROUP_HT:
+            mcsList = GetHtDeviceMcsList();
+            break;
+        case WIFI_MINSTREL_GROUP_VHT:
+            mcsList = GetVhtDeviceMcsList();
+            break;
+        case WIFI_MINSTREL_GROUP_HE:
+            mcsList = GetHeDeviceMcsList();
+            break;
+        }
+
+        std::vector<std::pair<double, uint8_t>> thresholds;
+        WifiTxVector txVector;
+        txVector.SetNss(group.streams);
+        txVector.SetChannelWidth(group.chWidth);
+        txVector.SetGuardInterval(group.gi);
+        for (uint8_t rateId = 0; rateId < m_numRates; rateId++)
+        {
+            // Rates that do not exist in the group have no transmit time
+            if (m_ratesFirstMpduTxTimeTable[GetIndex(groupId, rateId)].IsZero())
+            {
+                continue;
+            }
+            uint16_t deviceIndex = rateId;
+            if (group.type == WIFI_MINSTREL_GROUP_HT)
+            {
+                deviceIndex += (group.streams - 1) * MAX_HT_GROUP_RATES;
+            }
+            txVector.SetMode(mcsList[deviceIndex]);
+            // The noise grows with the channel width
+            thresholds.emplace_back(GetSnrThreshold(txVector) * group.chWidth / 20, rateId);
+            m_rateSnrThresholds[GetIndex(groupId, rateId)] =
+                10 * std::log10(thresholds.back().first);
+        }
+        std::sort(thresholds.begin(), thresholds.end());
+
+        uint16_t begin = GetIndex(groupId, 0);
+        for (std::size_t i = 0; i < thresholds.size(); i++)
+        {
+            m_groupSnrThresholds[begin + i] = thresholds[i].first;
+            m_groupSnrRates[begin + i] = thresholds[i].second;
+        }
+        m_groupSnrCounts[groupId] = thresholds.size();
+    }
+}
+
+double
+TARAWifiManager::GetSnrThreshold(WifiTxVector txVector)
+{
+    NS_LOG_FUNCTION(this << txVector);
+    double* threshold = GetSnrThresholdEntry(txVector);
+    if (*threshold == NO_SNR_THRESHOLD)
+    {
+        // This means capabilities have changed in runtime, hence compute the missing entry only
+        AddSnrThreshold(txVector, GetPhy()->CalculateSnr(txVector, m_ber));
+        threshold = GetSnrThresholdEntry(txVector);
+        NS_ASSERT_MSG(*threshold != NO_SNR_THRESHOLD, "SNR threshold not found");
+    }
+    return *threshold;
+}
+
+void
+TARAWifiManager::AddSnrThreshold(WifiTxVector txVector, double snr)
 {
     NS_LOG_FUNCTION(this << txVector.GetMode().GetUniqueName() << txVector.GetChannelWidth()
                          << snr);
-    m_thresholds.emplace_back(snr, txVector);
+    *GetSnrThresholdEntry(txVector) = snr;
+}
+
+uint16_t
+TARAWifiManager::GetSnrThresholdIndex(const WifiTxVector& txVector) const
+{
+    WifiMode mode = txVector.GetMode();
+    uint8_t classIndex;
+    uint8_t mcs = mode.GetMcsValue();
+    uint8_t nss = txVector.GetNss();
+    switch (mode.GetModulationClass())
+    {
+    case WIFI_MOD_CLASS_HT:
+        classIndex = 0;
+        // HT MCS indexes include the number of streams
+        nss = (mcs / MAX_HT_GROUP_RATES) + 1;
+        mcs %= MAX_HT_GROUP_RATES;
+        break;
+    case WIFI_MOD_CLASS_VHT:
+        classIndex = 1;
+        break;
+    case WIFI_MOD_CLASS_HE:
+        classIndex = 2;
+        break;
+    default:
+        NS_ABORT_MSG("No dense SNR threshold entry for modulation class "
+                     << mode.GetModulationClass());
+    }
+    uint8_t widthIndex;
+    uint16_t width = txVector.GetChannelWidth();
+    if (width >= 160)
+    {
+        widthIndex = 3;
+    }
+    else if (width >= 80)
+    {
+        widthIndex = 2;
+    }
+    else if (width >= 40)
+    {
+        widthIndex = 1;
+    }
+    else // 20 MHz
+    {
+        widthIndex = 0;
+    }
+    NS_ASSERT(mcs < SNR_TABLE_MCS && nss >= 1 && nss <= SNR_TABLE_STREAMS);
+    return ((classIndex * SNR_TABLE_MCS + mcs) * SNR_TABLE_STREAMS + (nss - 1)) *
+               SNR_TABLE_WIDTHS +
+           widthIndex;
 }
 
+double*
+TARAWifiManager::GetSnrThresholdEntry(const WifiTxVector& txVector)
+{
+    WifiMode mode = txVector.GetMode();
+    if (mode.GetModulationClass() == WIFI_MOD_CLASS_HT ||
+        mode.GetModulationClass() == WIFI_MOD_CLASS_VHT ||
+        mode.GetModulationClass() == WIFI_MOD_CLASS_HE)
+    {
+        return &m_snrThresholds[GetSnrThresholdIndex(txVector)];
+    }
+    uint32_t uid = mode.GetUid();
+    if (uid >= m_legacySnrThresholds.size())
+    {
+        m_legacySnrThresholds.resize(uid + 1, NO_SNR_THRESHOLD);
+    }
+    return &m_legacySnrThresholds[uid];
+}
 
 bool
 TARAWifiManager::IsValidMcs(Ptr<WifiPhy> phy,
@@ -586,42 +1769,160 @@ TARAWifiManager::CalculateMpduTxDuration(Ptr<WifiPhy> phy,
 }
 
 Time
-TARAWifiManager::GetFirstMpduTxTime(uint8_t groupId, WifiMode mode) const
+TARAWifiManager::CalculateMpduTxDuration(Ptr<WifiPhy> phy,
+                                         uint8_t streams,
+                                         uint16_t gi,
+                                         uint16_t chWidth,
+                                         WifiMode mode,
+                                         MpduType mpduType,
+                                         uint32_t length)
+{
+    NS_LOG_FUNCTION(this << phy << +streams << gi << chWidth << mode << mpduType << length);
+    WifiTxVector txvector;
+    txvector.SetNss(streams);
+    txvector.SetGuardInterval(gi);
+    txvector.SetChannelWidth(chWidth);
+    txvector.SetNess(0);
+    txvector.SetStbc(0);
+    txvector.SetMode(mode);
+    txvector.SetPreambleType(WIFI_PREAMBLE_HT_MF);
+    return WifiPhy::CalculatePhyPreambleAndHeaderDuration(txvector) +
+           WifiPhy::GetPayloadDuration(length, txvector, phy->GetPhyBand(), mpduType);
+}
+
+void
+TARAWifiManager::AddSizeClassTxTimes(uint8_t groupId, uint8_t rateId, WifiMode mode)
+{
+    NS_LOG_FUNCTION(this << +groupId << +rateId << mode);
+    const McsGroup& group = m_minstrelGroups[groupId];
+    std::size_t nRates = GetStatsArraySize(m_numGroups, m_numRates);
+    for (uint8_t c = 0; c < TARA_MPDU_SIZE_CLASSES; c++)
+    {
+        std::size_t index = c * nRates + GetIndex(groupId, rateId);
+        m_sizeClassFirstTxTime[index] = CalculateMpduTxDuration(GetPhy(),
+                                                                group.streams,
+                                                                group.gi,
+                                                                group.chWidth,
+                                                                mode,
+                                                                FIRST_MPDU_IN_AGGREGATE,
+                                                                MPDU_SIZE_CLASS_BYTES[c])
+                                            .GetSeconds();
+        m_sizeClassTxTime[index] = CalculateMpduTxDuration(GetPhy(),
+                                                           group.streams,
+                                                           group.gi,
+                                                           group.chWidth,
+                                                           mode,
+                                                           MIDDLE_MPDU_IN_AGGREGATE,
+                                                           MPDU_SIZE_CLASS_BYTES[c])
+                                       .GetSeconds();
+    }
+}
+
+void
+TARAWifiManager::NotifyMpduSize(Ptr<const WifiMpdu> mpdu)
+{
+    const WifiMacHeader& header = mpdu->GetHeader();
+    if (!header.IsQosData())
+    {
+        return;
+    }
+    // The MPDUs of an A-MPDU are notified one after the other: look the peer up once
+    if (m_lastMpduSizes == nullptr || header.GetAddr1() != m_lastMpduPeer)
+    {
+        m_lastMpduPeer = header.GetAddr1();
+        m_lastMpduSizes = &m_peers[m_lastMpduPeer].mpduSizes;
+    }
+    (*m_lastMpduSizes)[GetMpduSizeClass(mpdu->GetSize())]++;
+}
+
+void
+TARAWifiManager::UpdateAirtimes(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    std::array<double, TARA_MPDU_SIZE_CLASSES>& weights = station->m_sizeWeights;
+    bool seen = std::any_of(weights.begin(), weights.end(), [](double w) { return w > 0; });
+    if (station->m_mpduSizes != nullptr)
+    {
+        TARAMpduSizes& sizes = *station->m_mpduSizes;
+        uint32_t total = std::accumulate(sizes.begin(), sizes.end(), 0U);
+        for (uint8_t c = 0; total > 0 && c < TARA_MPDU_SIZE_CLASSES; c++)
+        {
+            double share = static_cast<double>(sizes[c]) / total;
+            weights[c] =
+                seen ? (share * (100 - m_ewmaLevel) + weights[c] * m_ewmaLevel) / 100 : share;
+            sizes[c] = 0;
+        }
+        seen = seen || total > 0;
+    }
+    if (!seen)
+    {
+        // No MPDU seen yet: keep the airtimes of PacketLength frames
+        return;
+    }
+
+    // Airtime per MPDU of an A-MPDU of the average length, over the size classes
+    TARARateStats& stats = station->m_stats;
+    std::size_t nRates = GetStatsArraySize(m_numGroups, m_numRates);
+    double ampduLen = std::max<uint32_t>(station->m_avgAmpduLen, 1);
+    for (std::size_t i = 0; i < m_numGroups * m_numRates; i++)
+    {
+        if (stats.supported[i] == 0)
+        {
+            continue;
+        }
+        double txTime = 0;
+        for (uint8_t c = 0; c < TARA_MPDU_SIZE_CLASSES; c++)
+        {
+            txTime += weights[c] *
+                      (m_sizeClassFirstTxTime[c * nRates + i] +
+                       (ampduLen - 1) * m_sizeClassTxTime[c * nRates + i]);
+        }
+        stats.txTime[i] = txTime / ampduLen;
+        if (stats.throughput[i] != 0)
+        {
+            stats.throughput[i] = Min(stats.ewmaProb[i], 90) / stats.txTime[i];
+        }
+    }
+}
+
+Time
+TARAWifiManager::GetFirstMpduTxTime(uint8_t groupId, uint8_t rateId) const
 {
-    NS_LOG_FUNCTION(this << +groupId << mode);
-    auto it = m_minstrelGroups[groupId].ratesFirstMpduTxTimeTable.find(mode);
-    NS_ASSERT(it != m_minstrelGroups[groupId].ratesFirstMpduTxTimeTable.end());
-    return it->second;
+    NS_LOG_FUNCTION(this << +groupId << +rateId);
+    Time t = m_ratesFirstMpduTxTimeTable[GetIndex(groupId, rateId)];
+    NS_ASSERT(!t.IsZero());
+    return t;
 }
 
 void
-TARAWifiManager::AddFirstMpduTxTime(uint8_t groupId, WifiMode mode, Time t)
+TARAWifiManager::AddFirstMpduTxTime(uint8_t groupId, uint8_t rateId, Time t)
 {
-    NS_LOG_FUNCTION(this << +groupId << mode << t);
-    m_minstrelGroups[groupId].ratesFirstMpduTxTimeTable.insert(std::make_pair(mode, t));
+    NS_LOG_FUNCTION(this << +groupId << +rateId << t);
+    m_ratesFirstMpduTxTimeTable[GetIndex(groupId, rateId)] = t;
 }
 
 Time
-TARAWifiManager::GetMpduTxTime(uint8_t groupId, WifiMode mode) const
+TARAWifiManager::GetMpduTxTime(uint8_t groupId, uint8_t rateId) const
 {
-    NS_LOG_FUNCTION(this << +groupId << mode);
-    auto it = m_minstrelGroups[groupId].ratesTxTimeTable.find(mode);
-    NS_ASSERT(it != m_minstrelGroups[groupId].ratesTxTimeTable.end());
-    return it->second;
+    NS_LOG_FUNCTION(this << +groupId << +rateId);
+    Time t = m_ratesTxTimeTable[GetIndex(groupId, rateId)];
+    NS_ASSERT(!t.IsZero());
+    return t;
 }
 
 void
-TARAWifiManager::AddMpduTxTime(uint8_t groupId, WifiMode mode, Time t)
+TARAWifiManager::AddMpduTxTime(uint8_t groupId, uint8_t rateId, Time t)
 {
-    NS_LOG_FUNCTION(this << +groupId << mode << t);
-    m_minstrelGroups[groupId].ratesTxTimeTable.insert(std::make_pair(mode, t));
+    NS_LOG_FUNCTION(this << +groupId << +rateId << t);
+    m_ratesTxTimeTable[GetIndex(groupId, rateId)] = t;
 }
 
 WifiRemoteStation*
 TARAWifiManager::DoCreateStation() const
 {
     NS_LOG_FUNCTION(this);
-    TARAWifiRemoteStation* station = new TARAWifiRemoteStation();
+    NS_ASSERT_MSG(m_stationPool != nullptr, "Station created before the manager is initialized");
+    TARAWifiRemoteStation* station = new (m_stationPool) TARAWifiRemoteStation();
 
     // Initialize variables common to both stations.
     station->m_nextStatsUpdate = Simulator::Now() + m_updateStats;
@@ -640,6 +1941,7 @@ TARAWifiManager::DoCreateStation() const
     station->m_longRetry = 0;
     station->m_txrate = 0;
     station->m_initialized = false;
+    station->m_legacyStation = nullptr;
 
     // Variables specific to HT station
     station->m_sampleGroup = 0;
@@ -652,6 +1954,32 @@ TARAWifiManager::DoCreateStation() const
     station->m_ampduLen = 0;
     station->m_ampduPacketCount = 0;
 
+    station->m_trajectory = nullptr;
+    station->m_taraRate = 0;
+    station->m_predictionError = 0;
+    station->m_moving = false;
+    station->m_samplingBoost = 0;
+    station->m_lastPredictedSnr = 0;
+    station->m_samplingAirtime = nullptr;
+    station->m_retries = 0;
+    station->m_dropped = 0;
+    station->m_snrBias = 0;
+    station->m_mpduSizes = nullptr;
+    station->m_sizeWeights.fill(0);
+    station->m_snrBiasVariance = SNR_BIAS_INITIAL_VARIANCE;
+    station->m_taraMaxTp = false;
+    station->m_lastDecision = 0;
+    station->m_lastDecisionChange = Simulator::Now();
+    station->m_powerLevel = m_powerControl ? m_maxPowerLevel : GetDefaultTxPowerLevel();
+    station->m_powerSnr = -std::numeric_limits<double>::infinity();
+
+    station->m_stats = CarveRateStats(m_stationPool->GetStatsBlock(station),
+                                      m_stationPool->GetStatsSize(),
+                                      m_numGroups,
+                                      m_numRates);
+    station->m_groupsTable = nullptr;
+    station->m_statsUpdates = 0;
+
     // If the device supports HT
     if (GetHtSupported())
     {
@@ -689,24 +2017,48 @@ TARAWifiManager::CheckInit(TARAWifiRemoteStation* station)
         {
             NS_LOG_INFO("non-HT station " << station);
             station->m_isHt = false;
-            // We will use non-HT minstrel for this station. Initialize the manager.
-            m_legacyManager->SetAttribute("UpdateStatistics", TimeValue(m_legacyUpdateStats));
-            m_legacyManager->SetAttribute("LookAroundRate", UintegerValue(m_lookAroundRate));
-            m_legacyManager->SetAttribute("EWMA", UintegerValue(m_ewmaLevel));
-            m_legacyManager->SetAttribute("SampleColumn", UintegerValue(m_nSampleCol));
-            m_legacyManager->SetAttribute("PacketLength", UintegerValue(m_frameLength));
-            m_legacyManager->SetAttribute("PrintStats", BooleanValue(m_printStats));
-            m_legacyManager->CheckInit(station);
+            // We will use non-HT minstrel for this station (configured by DoInitialize).
+            if (station->m_legacyStation == nullptr)
+            {
+                // A non-HT station has no statistics block: its slot holds the legacy state
+                station->m_stats = TARARateStats();
+                station->m_groupsTable = nullptr;
+                station->m_legacyStation = new (m_stationPool->GetLegacyStorage(station))
+                    MinstrelWifiRemoteStation();
+                station->m_legacyStation->m_state = station->m_state;
+                station->m_legacyStation->m_initialized = false;
+            }
+            m_legacyManager->CheckInit(station->m_legacyStation);
+            station->m_initialized = station->m_legacyStation->m_initialized;
         }
         else
         {
             NS_LOG_DEBUG("HT station " << station);
             station->m_isHt = true;
+            if (station->m_legacyStation != nullptr)
+            {
+                // Seen as non-HT before its capabilities were known: restore its statistics block
+                station->m_legacyStation->~MinstrelWifiRemoteStation();
+                station->m_legacyStation = nullptr;
+                std::memset(m_stationPool->GetLegacyStorage(station),
+                            0,
+                            m_stationPool->GetStatsSize());
+                station->m_stats = CarveRateStats(m_stationPool->GetStatsBlock(station),
+                                                  m_stationPool->GetStatsSize(),
+                                                  m_numGroups,
+                                                  m_numRates);
+            }
             station->m_nModes = GetNMcsSupported(station);
-            station->m_minstrelTable = MinstrelRate(station->m_nModes);
-            station->m_sampleTable = SampleRate(m_numRates, std::vector<uint8_t>(m_nSampleCol));
-            InitSampleTable(station);
+            if (m_sampleTable.empty())
+            {
+                InitSampleTable();
+            }
             RateInit(station);
+            // Bind the station to the link state of its peer (trajectory set before or after)
+            TARAPeer& peer = m_peers[station->m_state->m_address];
+            station->m_trajectory = &peer.trajectory;
+            station->m_samplingAirtime = &peer.samplingAirtime;
+            station->m_mpduSizes = &peer.mpduSizes;
             station->m_initialized = true;
         }
     }
@@ -731,7 +2083,14 @@ TARAWifiManager::DoReportRtsFailed(WifiRemoteStation* st)
         return;
     }
     NS_LOG_DEBUG("DoReportRtsFailed m_txrate = " << station->m_txrate);
-    station->m_shortRetry++;
+    if (!station->m_isHt)
+    {
+        station->m_legacyStation->m_shortRetry++;
+    }
+    else
+    {
+        station->m_shortRetry++;
+    }
 }
 
 void
@@ -774,15 +2133,15 @@ TARAWifiManager::DoReportDataFailed(WifiRemoteStation* st)
 
     if (!station->m_isHt)
     {
-        m_legacyManager->UpdateRate(station);
+        m_legacyManager->UpdateRate(station->m_legacyStation);
+        RecordDecision(station, station->m_legacyStation->m_txrate, TARA_REASON_LEGACY);
     }
     else if (station->m_longRetry < CountRetries(station))
     {
         uint8_t rateId = GetRateId(station->m_txrate);
         uint8_t groupId = GetGroupId(station->m_txrate);
-        station->m_groupsTable[groupId]
-            .m_ratesTable[rateId]
-            .numRateAttempt++; // Increment the attempts counter for the rate used.
+        station->m_stats.numRateAttempt[GetIndex(groupId, rateId)]++; // Increment the attempts counter for the rate used.
+        SetRateDirty(station->m_stats, station->m_txrate);
         UpdateRate(station);
     }
 }
@@ -804,54 +2163,58 @@ TARAWifiManager::DoReportDataOk(WifiRemoteStation* st,
     {
         return;
     }
-
-    NS_LOG_DEBUG("DoReportDataOk m_txrate = "
-                 << station->m_txrate
-                 << ", attempt = " << station->m_minstrelTable[station->m_txrate].numRateAttempt
-                 << ", success = " << station->m_minstrelTable[station->m_txrate].numRateSuccess
-                 << " (before update).");
+    UpdateSnrBias(station, dataSnr, dataChannelWidth);
 
     if (!station->m_isHt)
     {
-        station->m_minstrelTable[station->m_txrate].numRateSuccess++;
-        station->m_minstrelTable[station->m_txrate].numRateAttempt++;
+        MinstrelWifiRemoteStation* legacy = station->m_legacyStation;
+        NS_LOG_DEBUG("DoReportDataOk m_txrate = "
+                     << legacy->m_txrate
+                     << ", attempt = " << legacy->m_minstrelTable[legacy->m_txrate].numRateAttempt
+                     << ", success = " << legacy->m_minstrelTable[legacy->m_txrate].numRateSuccess
+                     << " (before update).");
 
-        m_legacyManager->UpdatePacketCounters(station);
+        legacy->m_minstrelTable[legacy->m_txrate].numRateSuccess++;
+        legacy->m_minstrelTable[legacy->m_txrate].numRateAttempt++;
+
+        m_legacyManager->UpdatePacketCounters(legacy);
 
         NS_LOG_DEBUG("DoReportDataOk m_txrate = "
-                     << station->m_txrate
-                     << ", attempt = " << station->m_minstrelTable[station->m_txrate].numRateAttempt
-                     << ", success = " << station->m_minstrelTable[station->m_txrate].numRateSuccess
+                     << legacy->m_txrate
+                     << ", attempt = " << legacy->m_minstrelTable[legacy->m_txrate].numRateAttempt
+                     << ", success = " << legacy->m_minstrelTable[legacy->m_txrate].numRateSuccess
                      << " (after update).");
 
         UpdateRetry(station);
-        m_legacyManager->UpdateStats(station);
+        m_legacyManager->UpdateStats(legacy);
 
-        if (station->m_nModes >= 1)
+        if (legacy->m_nModes >= 1)
         {
-            station->m_txrate = m_legacyManager->FindRate(station);
+            legacy->m_txrate = m_legacyManager->FindRate(legacy);
+            RecordDecision(station, legacy->m_txrate, TARA_REASON_LEGACY);
         }
     }
     else
     {
         uint8_t rateId = GetRateId(station->m_txrate);
         uint8_t groupId = GetGroupId(station->m_txrate);
-        station->m_groupsTable[groupId].m_ratesTable[rateId].numRateSuccess++;
-        station->m_groupsTable[groupId].m_ratesTable[rateId].numRateAttempt++;
+        station->m_stats.numRateSuccess[GetIndex(groupId, rateId)]++;
+        station->m_stats.numRateAttempt[GetIndex(groupId, rateId)]++;
+        SetRateDirty(station->m_stats, station->m_txrate);
 
         UpdatePacketCounters(station, 1, 0);
 
         NS_LOG_DEBUG("DoReportDataOk m_txrate = "
                      << station->m_txrate
-                     << ", attempt = " << station->m_minstrelTable[station->m_txrate].numRateAttempt
-                     << ", success = " << station->m_minstrelTable[station->m_txrate].numRateSuccess
+                     << ", attempt = " << station->m_stats.numRateAttempt[station->m_txrate]
+                     << ", success = " << station->m_stats.numRateSuccess[station->m_txrate]
                      << " (after update).");
 
         station->m_isSampling = false;
         station->m_sampleDeferred = false;
 
         UpdateRetry(station);
-        if (Simulator::Now() >= station->m_nextStatsUpdate)
+        if (!m_statsEvent.IsRunning() && Simulator::Now() >= station->m_nextStatsUpdate)
         {
             UpdateStats(station);
         }
@@ -880,17 +2243,21 @@ TARAWifiManager::DoReportFinalDataFailed(WifiRemoteStation* st)
     }
 
     NS_LOG_DEBUG("DoReportFinalDataFailed - TxRate=" << station->m_txrate);
+    station->m_dropped++;
+    m_retryStatsTrace(station->m_state->m_address, station->m_retries, station->m_dropped);
 
     if (!station->m_isHt)
     {
-        m_legacyManager->UpdatePacketCounters(station);
+        MinstrelWifiRemoteStation* legacy = station->m_legacyStation;
+        m_legacyManager->UpdatePacketCounters(legacy);
 
         UpdateRetry(station);
 
-        m_legacyManager->UpdateStats(station);
-        if (station->m_nModes >= 1)
+        m_legacyManager->UpdateStats(legacy);
+        if (legacy->m_nModes >= 1)
         {
-            station->m_txrate = m_legacyManager->FindRate(station);
+            legacy->m_txrate = m_legacyManager->FindRate(legacy);
+            RecordDecision(station, legacy->m_txrate, TARA_REASON_LEGACY);
         }
     }
     else
@@ -901,7 +2268,7 @@ TARAWifiManager::DoReportFinalDataFailed(WifiRemoteStation* st)
         station->m_sampleDeferred = false;
 
         UpdateRetry(station);
-        if (Simulator::Now() >= station->m_nextStatsUpdate)
+        if (!m_statsEvent.IsRunning() && Simulator::Now() >= station->m_nextStatsUpdate)
         {
             UpdateStats(station);
         }
@@ -936,6 +2303,10 @@ TARAWifiManager::DoReportAmpduTxStatus(WifiRemoteStation* st,
     }
 
     NS_ASSERT_MSG(station->m_isHt, "A-MPDU Tx Status called but this is a non-HT STA.");
+    if (nSuccessfulMpdus > 0)
+    {
+        UpdateSnrBias(station, dataSnr, dataChannelWidth);
+    }
 
     NS_LOG_DEBUG("DoReportAmpduTxStatus. TxRate=" << station->m_txrate
                                                   << " SuccMpdus=" << nSuccessfulMpdus
@@ -948,9 +2319,10 @@ TARAWifiManager::DoReportAmpduTxStatus(WifiRemoteStation* st,
 
     uint8_t rateId = GetRateId(station->m_txrate);
     uint8_t groupId = GetGroupId(station->m_txrate);
-    station->m_groupsTable[groupId].m_ratesTable[rateId].numRateSuccess += nSuccessfulMpdus;
-    station->m_groupsTable[groupId].m_ratesTable[rateId].numRateAttempt +=
+    station->m_stats.numRateSuccess[GetIndex(groupId, rateId)] += nSuccessfulMpdus;
+    station->m_stats.numRateAttempt[GetIndex(groupId, rateId)] +=
         nSuccessfulMpdus + nFailedMpdus;
+    SetRateDirty(station->m_stats, station->m_txrate);
 
     if (nSuccessfulMpdus == 0 && station->m_longRetry < CountRetries(station))
     {
@@ -963,7 +2335,7 @@ TARAWifiManager::DoReportAmpduTxStatus(WifiRemoteStation* st,
         station->m_sampleDeferred = false;
 
         UpdateRetry(station);
-        if (Simulator::Now() >= station->m_nextStatsUpdate)
+        if (!m_statsEvent.IsRunning() && Simulator::Now() >= station->m_nextStatsUpdate)
         {
             UpdateStats(station);
         }
@@ -1008,6 +2380,10 @@ TARAWifiManager::UpdateRate(TARAWifiRemoteStation* station)
         return;
     }
     station->m_longRetry++;
+    station->m_retries++;
+    m_retryStatsTrace(station->m_state->m_address, station->m_retries, station->m_dropped);
+    uint16_t oldRate = station->m_txrate;
+    bool taraRetry = false;
 
     /**
      * Get the IDs for all rates.
@@ -1024,8 +2400,10 @@ TARAWifiManager::UpdateRate(TARAWifiRemoteStation* station)
     {
         /// Use best throughput rate.
         // ----------------- TARA-config ----------------- 
-        if (station ->m_longRetry < 2){
-            station->m_txrate = m_TARARate;
+        if (!m_predictionBlending && station->m_longRetry < 2)
+        {
+            station->m_txrate = station->m_taraRate;
+            taraRetry = true;
         }
         // ----------------- TARA-config ----------------- 
         if (station->m_longRetry <
@@ -1067,10 +2445,11 @@ TARAWifiManager::UpdateRate(TARAWifiRemoteStation* station)
         /// Use the best rate.
         
         // ----------------- TARA-config ----------------- 
-        if (station->m_longRetry < 1 + 2)
+        if (!m_predictionBlending && station->m_longRetry < 1 + 2)
         {
             NS_LOG_DEBUG("Sampling use the TARA rate");
-            station->m_txrate = m_TARARate;
+            station->m_txrate = station->m_taraRate;
+            taraRetry = true;
         }
         // ----------------- TARA-config ----------------- 
         else if (station->m_longRetry <
@@ -1094,6 +2473,16 @@ TARAWifiManager::UpdateRate(TARAWifiRemoteStation* station)
                            << station->m_longRetry);
         }
     }
+    Tracepoint(station,
+               TARA_TRACE_RETRY,
+               oldRate,
+               station->m_txrate,
+               station->m_longRetry,
+               station->m_isSampling);
+    RecordDecision(station,
+                   station->m_txrate,
+                   taraRetry && station->m_txrate == station->m_taraRate ? TARA_REASON_TARA
+                                                                         : TARA_REASON_RETRY_CHAIN);
     NS_LOG_DEBUG("Next rate to use TxRate = " << station->m_txrate);
 }
 
@@ -1103,6 +2492,11 @@ TARAWifiManager::UpdateRetry(TARAWifiRemoteStation* station)
     NS_LOG_FUNCTION(this << station);
     station->m_shortRetry = 0;
     station->m_longRetry = 0;
+    if (station->m_legacyStation != nullptr)
+    {
+        station->m_legacyStation->m_shortRetry = 0;
+        station->m_legacyStation->m_longRetry = 0;
+    }
 }
 
 void
@@ -1116,6 +2510,12 @@ TARAWifiManager::UpdatePacketCounters(TARAWifiRemoteStation* station,
     if (station->m_isSampling)
     {
         station->m_samplePacketsCount += nSuccessfulMpdus + nFailedMpdus;
+        if (station->m_samplingAirtime != nullptr && nSuccessfulMpdus + nFailedMpdus > 0)
+        {
+            *station->m_samplingAirtime +=
+                m_ratesFirstMpduTxTimeTable[station->m_txrate] +
+                m_ratesTxTimeTable[station->m_txrate] * (nSuccessfulMpdus + nFailedMpdus - 1);
+        }
     }
     if (station->m_totalPacketsCount == ~0)
     {
@@ -1202,9 +2602,9 @@ TARAWifiManager::DoGetDataTxVector(WifiRemoteStation* st, uint16_t allowedWidth)
 
     if (!station->m_isHt)
     {
-        WifiTxVector vector = m_legacyManager->GetDataTxVector(station);
+        WifiTxVector vector = m_legacyManager->GetDataTxVector(station->m_legacyStation);
         uint64_t dataRate = vector.GetMode().GetDataRate(vector);
-        if (m_currentRate != dataRate && !station->m_isSampling)
+        if (m_currentRate != dataRate && !station->m_legacyStation->m_isSampling)
         {
             NS_LOG_DEBUG("New datarate: " << dataRate);
             m_currentRate = dataRate;
@@ -1242,9 +2642,17 @@ TARAWifiManager::DoGetDataTxVector(WifiRemoteStation* st, uint16_t allowedWidth)
                            << "," << GetChannelWidth(station) << ")");
         }
         WifiMode mode = GetMcsSupported(station, mcsIndex);
+        uint8_t powerLevel = GetTxPowerLevel(station, station->m_txrate);
+        if (powerLevel != station->m_powerLevel)
+        {
+            m_powerChangeTrace(GetPhy()->GetTxPowerStart() + station->m_powerLevel * m_powerStep,
+                               GetPhy()->GetTxPowerStart() + powerLevel * m_powerStep,
+                               station->m_state->m_address);
+            station->m_powerLevel = powerLevel;
+        }
         WifiTxVector txVector{
             mode,
-            GetDefaultTxPowerLevel(),
+            powerLevel,
             GetPreambleForTransmission(mode.GetModulationClass(), GetShortPreambleEnabled()),
             group.gi,
             GetNumberOfAntennas(),
@@ -1275,7 +2683,7 @@ TARAWifiManager::DoGetRtsTxVector(WifiRemoteStation* st)
 
     if (!station->m_isHt)
     {
-        return m_legacyManager->GetRtsTxVector(station);
+        return m_legacyManager->GetRtsTxVector(station->m_legacyStation);
     }
     else
     {
@@ -1362,25 +2770,28 @@ TARAWifiManager::DoNeedRetransmission(WifiRemoteStation* st,
     }
 
     uint32_t maxRetries;
+    uint32_t longRetry;
 
     if (!station->m_isHt)
     {
-        maxRetries = m_legacyManager->CountRetries(station);
+        maxRetries = m_legacyManager->CountRetries(station->m_legacyStation);
+        longRetry = station->m_legacyStation->m_longRetry;
     }
     else
     {
         maxRetries = CountRetries(station);
+        longRetry = station->m_longRetry;
     }
 
-    if (station->m_longRetry >= maxRetries)
+    if (longRetry >= maxRetries)
     {
-        NS_LOG_DEBUG("No re-transmission allowed. Retries: " << station->m_longRetry
+        NS_LOG_DEBUG("No re-transmission allowed. Retries: " << longRetry
                                                              << " Max retries: " << maxRetries);
         return false;
     }
     else
     {
-        NS_LOG_DEBUG("Re-transmit. Retries: " << station->m_longRetry
+        NS_LOG_DEBUG("Re-transmit. Retries: " << longRetry
                                               << " Max retries: " << maxRetries);
         return true;
     }
@@ -1416,7 +2827,7 @@ TARAWifiManager::GetNextSample(TARAWifiRemoteStation* station)
     uint8_t sampleGroup = station->m_sampleGroup;
     uint8_t index = station->m_groupsTable[sampleGroup].m_index;
     uint8_t col = station->m_groupsTable[sampleGroup].m_col;
-    uint8_t sampleIndex = station->m_sampleTable[index][col];
+    uint8_t sampleIndex = m_sampleTable[index][col];
     uint16_t rateIndex = GetIndex(sampleGroup, sampleIndex);
     NS_LOG_DEBUG("Next Sample is " << rateIndex);
     SetNextSample(station); // Calculate the next sample rate.
@@ -1451,7 +2862,7 @@ TARAWifiManager::SetNextSample(TARAWifiRemoteStation* station)
         col = station->m_groupsTable[sampleGroup].m_col;
     }
     NS_LOG_DEBUG("New sample set: group= " << +sampleGroup
-                                           << " index= " << +station->m_sampleTable[index][col]);
+                                           << " index= " << +m_sampleTable[index][col]);
 }
 
 uint16_t
@@ -1460,8 +2871,10 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
     NS_LOG_FUNCTION(this << station);
     NS_LOG_DEBUG("FindRate packet=" << station->m_totalPacketsCount);
 
+    TARARateReason reason = station->m_taraMaxTp ? TARA_REASON_TARA : TARA_REASON_MAX_TP;
     if ((station->m_samplePacketsCount + station->m_totalPacketsCount) == 0)
     {
+        RecordDecision(station, station->m_maxTpRate, reason);
         return station->m_maxTpRate;
     }
 
@@ -1489,16 +2902,17 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
              * Also do not sample if the probability is already higher than 95%
              * to avoid wasting airtime.
              */
-            TARARateInfo sampleRateInfo =
+            const TARARateInfo& sampleRateInfo =
                 station->m_groupsTable[sampleGroupId].m_ratesTable[sampleRateId];
+            double sampleEwmaProb = station->m_stats.ewmaProb[sampleIdx];
 
             NS_LOG_DEBUG("Use sample rate? MaxTpRate= "
                          << station->m_maxTpRate << " CurrentRate= " << station->m_txrate
                          << " SampleRate= " << sampleIdx
-                         << " SampleProb= " << sampleRateInfo.ewmaProb);
+                         << " SampleProb= " << sampleEwmaProb);
 
             if (sampleIdx != station->m_maxTpRate && sampleIdx != station->m_maxTpRate2 &&
-                sampleIdx != station->m_maxProbRate && sampleRateInfo.ewmaProb <= 95)
+                sampleIdx != station->m_maxProbRate && sampleEwmaProb <= 95)
             {
                 /**
                  * Make sure that lower rates get sampled only occasionally,
@@ -1514,12 +2928,9 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
                 uint8_t maxTpStreams = m_minstrelGroups[maxTpGroupId].streams;
                 uint8_t sampleStreams = m_minstrelGroups[sampleGroupId].streams;
 
-                Time sampleDuration = sampleRateInfo.perfectTxTime;
-                Time maxTp2Duration =
-                    station->m_groupsTable[maxTp2GroupId].m_ratesTable[maxTp2RateId].perfectTxTime;
-                Time maxProbDuration = station->m_groupsTable[maxProbGroupId]
-                                           .m_ratesTable[maxProbRateId]
-                                           .perfectTxTime;
+                Time sampleDuration = GetFirstMpduTxTime(sampleGroupId, sampleRateId);
+                Time maxTp2Duration = GetFirstMpduTxTime(maxTp2GroupId, maxTp2RateId);
+                Time maxProbDuration = GetFirstMpduTxTime(maxProbGroupId, maxProbRateId);
 
                 NS_LOG_DEBUG("Use sample rate? SampleDuration= "
                              << sampleDuration << " maxTp2Duration= " << maxTp2Duration
@@ -1537,12 +2948,20 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
                     NS_LOG_DEBUG("FindRate "
                                  << "sampleRate=" << sampleIdx);
                     station->m_sampleTries--;
+                    Tracepoint(station,
+                               TARA_TRACE_SAMPLE,
+                               station->m_maxTpRate,
+                               sampleIdx,
+                               station->m_sampleTries);
+                    RecordDecision(station, sampleIdx, TARA_REASON_SAMPLING);
                     return sampleIdx;
                 }
                 else
                 {
                     station->m_numSamplesSlow++;
-                    if (sampleRateInfo.numSamplesSkipped >= 20 && station->m_numSamplesSlow <= 2)
+                    uint32_t numSamplesSkipped =
+                        station->m_statsUpdates - sampleRateInfo.lastUpdate;
+                    if (numSamplesSkipped >= 20 && station->m_numSamplesSlow <= 2)
                     {
                         /// Set flag that we are currently sampling.
                         station->m_isSampling = true;
@@ -1553,6 +2972,12 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
                         NS_LOG_DEBUG("FindRate "
                                      << "sampleRate=" << sampleIdx);
                         station->m_sampleTries--;
+                        Tracepoint(station,
+                                   TARA_TRACE_SAMPLE,
+                                   station->m_maxTpRate,
+                                   sampleIdx,
+                                   station->m_sampleTries);
+                        RecordDecision(station, sampleIdx, TARA_REASON_SAMPLING);
                         return sampleIdx;
                     }
                 }
@@ -1568,9 +2993,131 @@ TARAWifiManager::FindRate(TARAWifiRemoteStation* station)
 
     NS_LOG_DEBUG("FindRate "
                  << "maxTpRrate=" << station->m_maxTpRate);
+    RecordDecision(station, station->m_maxTpRate, reason);
     return station->m_maxTpRate;
 }
 
+void
+TARAWifiManager::UpdateDueStats()
+{
+    NS_LOG_FUNCTION(this);
+    m_statsEvent = Simulator::Schedule(m_updateStats, &TARAWifiManager::UpdateDueStats, this);
+    if (m_stationPool == nullptr)
+    {
+        return;
+    }
+    // Only the stations whose period has elapsed are updated: a station created
+    // or updated less than one period ago waits for the next tick, so its
+    // statistics always cover at least one period
+    Time now = Simulator::Now();
+    m_stationPool->ForEachStation([this, now](void* p) {
+        TARAWifiRemoteStation* station = static_cast<TARAWifiRemoteStation*>(p);
+        if (station->m_initialized && station->m_isHt && station->m_nextStatsUpdate <= now)
+        {
+            UpdateStats(station);
+        }
+    });
+}
+
+#ifdef TARA_BENCH_HOOKS
+TARAWifiRemoteStation*
+TARAWifiManager::GetPooledStation(Mac48Address address) const
+{
+    TARAWifiRemoteStation* found = nullptr;
+    m_stationPool->ForEachStation([address, &found](void* p) {
+        TARAWifiRemoteStation* station = static_cast<TARAWifiRemoteStation*>(p);
+        if (station->m_state->m_address == address)
+        {
+            found = station;
+        }
+    });
+    return found;
+}
+#endif
+
+void
+TARAWifiManager::RecordDecision(TARAWifiRemoteStation* station,
+                                uint16_t index,
+                                TARARateReason reason)
+{
+    m_decisionCounts[reason]++;
+    Time sinceLastChange = Simulator::Now() - station->m_lastDecisionChange;
+    if (index != station->m_lastDecision)
+    {
+        station->m_lastDecision = index;
+        station->m_lastDecisionChange = Simulator::Now();
+    }
+    if (m_rateDecisionTrace.IsEmpty())
+    {
+        return;
+    }
+    TARARateDecision decision;
+    decision.station = station->m_state->m_address;
+    decision.index = index;
+    decision.reason = reason;
+    decision.predictedSnr = GetPredictedSnr(station, Simulator::Now());
+    decision.ewmaProb = station->m_isHt ? station->m_stats.ewmaProb[index]
+                                        : station->m_legacyStation->m_minstrelTable[index].ewmaProb;
+    decision.sinceLastChange = sinceLastChange;
+    m_rateDecisionTrace(decision);
+}
+
+uint64_t
+TARAWifiManager::GetDecisionCount(TARARateReason reason) const
+{
+    NS_ASSERT(reason < TARA_REASON_COUNT);
+    return m_decisionCounts[reason];
+}
+
+void
+TARAWifiManager::Tracepoint(const TARAWifiRemoteStation* station,
+                            uint8_t type,
+                            uint16_t oldRate,
+                            uint16_t newRate,
+                            uint32_t value0,
+                            uint32_t value1,
+                            float snr)
+{
+    if (m_traceRing.empty())
+    {
+        return;
+    }
+    TARATraceEvent& event = m_traceRing[m_traceCount++ % m_traceRing.size()];
+    event.time = Simulator::Now().GetNanoSeconds();
+    station->m_state->m_address.CopyTo(event.station);
+    event.type = type;
+    event.reserved = 0;
+    event.oldRate = oldRate;
+    event.newRate = newRate;
+    event.snr = snr;
+    event.value[0] = value0;
+    event.value[1] = value1;
+}
+
+void
+TARAWifiManager::DumpTracepoints(const std::string& fileName) const
+{
+    NS_LOG_FUNCTION(this << fileName);
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        NS_LOG_UNCOND("Cannot create tracepoint file " << fileName);
+        return;
+    }
+    uint64_t nEvents = std::min<uint64_t>(m_traceCount, m_traceRing.size());
+    TARATraceFileHeader header;
+    std::memcpy(header.magic, TARA_TRACE_MAGIC, sizeof(header.magic));
+    header.version = TARA_TRACE_VERSION;
+    header.recordSize = sizeof(TARATraceEvent);
+    header.nEvents = nEvents;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (uint64_t n = m_traceCount - nEvents; n < m_traceCount; n++)
+    {
+        out.write(reinterpret_cast<const char*>(&m_traceRing[n % m_traceRing.size()]),
+                  sizeof(TARATraceEvent));
+    }
+}
+
 void
 TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
 {
@@ -1582,8 +3129,6 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
     station->m_numSamplesSlow = 0;
     station->m_sampleCount = 0;
 
-    double tempProb;
-
     if (station->m_ampduPacketCount > 0)
     {
         uint32_t newLen = station->m_ampduLen / station->m_ampduPacketCount;
@@ -1592,13 +3137,23 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
         station->m_ampduLen = 0;
         station->m_ampduPacketCount = 0;
     }
+    UpdateAirtimes(station);
+
+    /// Update probability, EWMA and throughput of the rates attempted in this interval.
+    station->m_statsUpdates++;
+    UpdateRateStats(station);
+
+    uint16_t oldMaxTpRate = station->m_maxTpRate;
+    uint16_t oldMaxTpRate2 = station->m_maxTpRate2;
+    uint16_t oldMaxProbRate = station->m_maxProbRate;
 
     /* Initialize global rate indexes */
+    station->m_taraMaxTp = false;
     station->m_maxTpRate = GetLowestIndex(station);
     station->m_maxTpRate2 = GetLowestIndex(station);
     station->m_maxProbRate = GetLowestIndex(station);
 
-    /// Update throughput and EWMA for each rate inside each group.
+    /// Best rates selection over the throughput of each rate inside each group.
     for (uint8_t j = 0; j < m_numGroups; j++)
     {
         if (station->m_groupsTable[j].m_supported)
@@ -1612,6 +3167,7 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
 
             for (uint8_t i = 0; i < m_numRates; i++)
             {
+                uint16_t index = GetIndex(j, i);
                 if (station->m_groupsTable[j].m_ratesTable[i].supported)
                 {
                     station->m_groupsTable[j].m_ratesTable[i].retryUpdated = false;
@@ -1620,70 +3176,13 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
                         +i << " "
                            << GetMcsSupported(station,
                                               station->m_groupsTable[j].m_ratesTable[i].mcsIndex)
-                           << "\t attempt="
-                           << station->m_groupsTable[j].m_ratesTable[i].numRateAttempt
-                           << "\t success="
-                           << station->m_groupsTable[j].m_ratesTable[i].numRateSuccess);
+                           << "\t ewmaProb=" << station->m_stats.ewmaProb[index]
+                           << "\t throughput=" << station->m_stats.throughput[index]);
 
-                    /// If we've attempted something.
-                    if (station->m_groupsTable[j].m_ratesTable[i].numRateAttempt > 0)
+                    if (station->m_stats.throughput[index] != 0)
                     {
-                        station->m_groupsTable[j].m_ratesTable[i].numSamplesSkipped = 0;
-                        /**
-                         * Calculate the probability of success.
-                         * Assume probability scales from 0 to 100.
-                         */
-                        tempProb =
-                            (100 * station->m_groupsTable[j].m_ratesTable[i].numRateSuccess) /
-                            station->m_groupsTable[j].m_ratesTable[i].numRateAttempt;
-
-                        /// Bookkeeping.
-                        station->m_groupsTable[j].m_ratesTable[i].prob = tempProb;
-
-                        if (station->m_groupsTable[j].m_ratesTable[i].successHist == 0)
-                        {
-                            station->m_groupsTable[j].m_ratesTable[i].ewmaProb = tempProb;
-                        }
-                        else
-                        {
-                            station->m_groupsTable[j].m_ratesTable[i].ewmsdProb =
-                                CalculateEwmsd(station->m_groupsTable[j].m_ratesTable[i].ewmsdProb,
-                                               tempProb,
-                                               station->m_groupsTable[j].m_ratesTable[i].ewmaProb,
-                                               m_ewmaLevel);
-                            /// EWMA probability
-                            tempProb =
-                                (tempProb * (100 - m_ewmaLevel) +
-                                 station->m_groupsTable[j].m_ratesTable[i].ewmaProb * m_ewmaLevel) /
-                                100;
-                            station->m_groupsTable[j].m_ratesTable[i].ewmaProb = tempProb;
-                        }
-
-                        station->m_groupsTable[j].m_ratesTable[i].throughput =
-                            CalculateThroughput(station, j, i, tempProb);
-
-                        station->m_groupsTable[j].m_ratesTable[i].successHist +=
-                            station->m_groupsTable[j].m_ratesTable[i].numRateSuccess;
-                        station->m_groupsTable[j].m_ratesTable[i].attemptHist +=
-                            station->m_groupsTable[j].m_ratesTable[i].numRateAttempt;
-                    }
-                    else
-                    {
-                        station->m_groupsTable[j].m_ratesTable[i].numSamplesSkipped++;
-                    }
-
-                    /// Bookkeeping.
-                    station->m_groupsTable[j].m_ratesTable[i].prevNumRateSuccess =
-                        station->m_groupsTable[j].m_ratesTable[i].numRateSuccess;
-                    station->m_groupsTable[j].m_ratesTable[i].prevNumRateAttempt =
-                        station->m_groupsTable[j].m_ratesTable[i].numRateAttempt;
-                    station->m_groupsTable[j].m_ratesTable[i].numRateSuccess = 0;
-                    station->m_groupsTable[j].m_ratesTable[i].numRateAttempt = 0;
-
-                    if (station->m_groupsTable[j].m_ratesTable[i].throughput != 0)
-                    {
-                        SetBestStationThRates(station, GetIndex(j, i));
-                        SetBestProbabilityRate(station, GetIndex(j, i));
+                        SetBestStationThRates(station, index);
+                        SetBestProbabilityRate(station, index);
                     }
                 }
             }
@@ -1691,60 +3190,23 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
     }
 
     // ----------------- TARA-config -----------------     
-    //inspired from IdealWifiManager
-
-    WifiTxVector txVector;
-    //txVector.SetChannelWidth(GetChannelWidth(station));
-    txVector.SetChannelWidth(20);
-    uint16_t guardInterval = static_cast<uint16_t>(
-    std::max(GetShortGuardIntervalSupported(station) ? 400 : 800,
-                GetShortGuardIntervalSupported() ? 400 : 800));
-    txVector.SetGuardInterval(guardInterval);
-    txVector.SetNss(1);
-    
-    // NS_LOG_UNCOND(" Current TARARate: " << m_TARARate << " | Current MaxTP: " << station->m_maxTpRate << " | Current MaxTP2: " << station->m_maxTpRate2 << " | Current MaxProb: " << station->m_maxProbRate);
-    
-    double currentSnr = pow(10, m_TARASnr / 10);
-    double candidateThreshold;
-    uint16_t newRateId = 0;
-    uint64_t TARARate = 0;
-    for (uint8_t i = 0; i < GetNMcsSupported(station); i++)
-    {
-        WifiMode mode = GetMcsSupported(station, i);
-        txVector.SetMode(mode);
-        uint64_t candidateDataRate = mode.GetDataRate(txVector.GetChannelWidth(),
-                                                txVector.GetGuardInterval(),
-                                                1); // nss = 1
+    UpdatePredictionError(station);
+    UpdateTaraRate(station);
 
-        candidateThreshold = GetSnrThreshold(txVector);
-        //NS_LOG_UNCOND("Current SNR: " << currentSnr << " | CandidateThreshold: " << candidateThreshold);
-        //NS_LOG_UNCOND("Current Rate: " << TARARate << " | CandidateRate: " << candidateDataRate);
-        
-        if (currentSnr > candidateThreshold && candidateDataRate > TARARate)
-        {
-            //NS_LOG_UNCOND("Entrei");
-            TARARate = candidateDataRate;
-            newRateId = i;   
-        }
-    }
-    
-    if(newRateId != m_TARARate)
+    if (m_predictionBlending)
     {
-        NS_LOG_UNCOND("Old TARARate: " << m_TARARate << " | New TARARate: " << newRateId);
-        NS_LOG_UNCOND("Current SNR: " << currentSnr << " | Threshold of rate_ " << newRateId << ": " << candidateThreshold);
-        m_TARARate = newRateId;
+        BlendTaraRate(station);
     }
-
-    //NS_LOG_UNCOND("New TARARate: " << m_TARARate);
     //After updating Station Th Rates, MaxTP becomes MaxTP2, MaxTP2 is no longer used... and the new MaxTP comes from TARA
-    
-    if(m_TARARate > station->m_maxTpRate)
+    else if (station->m_stats.txTime[station->m_taraRate] <
+             station->m_stats.txTime[station->m_maxTpRate])
     {
         station->m_maxTpRate2 = station->m_maxTpRate;
-        station->m_maxTpRate = m_TARARate;    
+        station->m_maxTpRate = station->m_taraRate;    
+        station->m_taraMaxTp = true;
     }
     //station->m_maxTpRate2 = station->m_maxTpRate;
-    //station->m_maxTpRate = m_TARARate;
+    //station->m_maxTpRate = station->m_taraRate;
     //station->m_maxTpRate = 7;
 
     //station->m_maxTpRate2 = station->m_maxTpRate;
@@ -1753,13 +3215,28 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
     // ----------------- TARA-config ----------------- 
 
     // Try to sample all available rates during each interval.
-    station->m_sampleCount *= 8;
+    station->m_sampleCount *= m_adaptiveSampling ? GetSamplingBudget(station) : 8;
 
     // Recalculate retries for the rates selected.
     CalculateRetransmits(station, station->m_maxTpRate);
     CalculateRetransmits(station, station->m_maxTpRate2);
     CalculateRetransmits(station, station->m_maxProbRate);
+    if (m_predictiveRetry)
+    {
+        UpdateRetryChain(station);
+        CalculateRetransmits(station, station->m_maxTpRate2);
+    }
 
+    if (station->m_maxTpRate != oldMaxTpRate || station->m_maxTpRate2 != oldMaxTpRate2 ||
+        station->m_maxProbRate != oldMaxProbRate)
+    {
+        Tracepoint(station,
+                   TARA_TRACE_STATS_UPDATE,
+                   oldMaxTpRate,
+                   station->m_maxTpRate,
+                   station->m_maxTpRate2,
+                   station->m_maxProbRate);
+    }
     NS_LOG_DEBUG("max tp=" << station->m_maxTpRate << "\nmax tp2=" << station->m_maxTpRate2
                            << "\nmax prob=" << station->m_maxProbRate);
     if (m_printStats)
@@ -1768,6 +3245,390 @@ TARAWifiManager::UpdateStats(TARAWifiRemoteStation* station)
     }
 }
 
+void
+TARAWifiManager::UpdateTaraRate(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+
+    double snr = GetPredictedSnr(station, Simulator::Now());
+    double currentSnr = pow(10, snr / 10);
+    // The wider channels must also be sustained until WidthLookahead
+    double wideSnr =
+        GetLowestPredictedSnr(station, Simulator::Now(), Simulator::Now() + m_widthLookahead);
+    uint16_t taraRate = GetSnrRate(station, currentSnr, pow(10, wideSnr / 10));
+    if (taraRate != station->m_taraRate)
+    {
+        NS_LOG_DEBUG("Old TARARate: " << station->m_taraRate << " | New TARARate: " << taraRate
+                     << " | Peer: " << station->m_state->m_address);
+        NS_LOG_DEBUG("Current SNR: " << currentSnr << " | Group " << +GetGroupId(taraRate)
+                     << " rate " << +GetRateId(taraRate));
+        Tracepoint(station,
+                   TARA_TRACE_TARA_RATE,
+                   station->m_taraRate,
+                   taraRate,
+                   0,
+                   0,
+                   snr);
+        station->m_taraRate = taraRate;
+    }
+
+    TARATrajectory* trajectory = station->m_trajectory;
+    if (m_powerControl && trajectory != nullptr && trajectory->valid)
+    {
+        // The power level must sustain the rate until the next stats update
+        station->m_powerSnr =
+            GetLowestPredictedSnr(station, Simulator::Now(), Simulator::Now() + m_updateStats);
+    }
+}
+
+uint8_t
+TARAWifiManager::GetTxPowerLevel(TARAWifiRemoteStation* station, uint16_t index)
+{
+    NS_LOG_FUNCTION(this << station << index);
+    if (!m_powerControl)
+    {
+        return GetDefaultTxPowerLevel();
+    }
+    double headroom = station->m_powerSnr - m_rateSnrThresholds[index] - m_powerMargin;
+    if (m_powerStep <= 0 || !(headroom > 0))
+    {
+        return m_maxPowerLevel;
+    }
+    return m_maxPowerLevel - std::min<double>(m_maxPowerLevel, std::floor(headroom / m_powerStep));
+}
+
+uint16_t
+TARAWifiManager::GetSnrRate(TARAWifiRemoteStation* station, double snr, double wideSnr)
+{
+    NS_LOG_FUNCTION(this << station << snr << wideSnr);
+    uint16_t bestRate = station->m_maxProbRate;
+    double bestTxTime = 0;
+    for (uint8_t groupId = 0; groupId < m_numGroups; groupId++)
+    {
+        if (!station->m_groupsTable[groupId].m_supported)
+        {
+            continue;
+        }
+        // The thresholds of the group are sorted: the rates before the first
+        // threshold not below the SNR are the candidates. The throughput of the
+        // rates of a group grows with their SNR threshold, so the best candidate
+        // is the last one supported by the station.
+        uint16_t begin = GetIndex(groupId, 0);
+        const double* thresholds = &m_groupSnrThresholds[begin];
+        double groupSnr = m_minstrelGroups[groupId].chWidth > 20 ? wideSnr : snr;
+        std::size_t n =
+            std::lower_bound(thresholds, thresholds + m_groupSnrCounts[groupId], groupSnr) -
+            thresholds;
+        while (n > 0 &&
+               !station->m_groupsTable[groupId].m_ratesTable[m_groupSnrRates[begin + n - 1]].supported)
+        {
+            n--;
+        }
+        if (n == 0)
+        {
+            continue;
+        }
+        uint16_t index = GetIndex(groupId, m_groupSnrRates[begin + n - 1]);
+        if (bestTxTime == 0 || station->m_stats.txTime[index] < bestTxTime)
+        {
+            bestRate = index;
+            bestTxTime = station->m_stats.txTime[index];
+        }
+    }
+    return bestRate;
+}
+
+void
+TARAWifiManager::UpdateRetryChain(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    TARATrajectory* trajectory = station->m_trajectory;
+    if (trajectory == nullptr || !trajectory->valid)
+    {
+        return;
+    }
+    Time now = Simulator::Now();
+    double snrNow = GetPredictedSnr(station, now);
+    double snrAhead = GetPredictedSnr(station, now + m_retryLookahead);
+    if (snrAhead == snrNow)
+    {
+        return;
+    }
+    double aheadSnr = pow(10, snrAhead / 10);
+    uint16_t aheadRate = GetSnrRate(station, aheadSnr, aheadSnr);
+    if (aheadRate == station->m_maxTpRate)
+    {
+        return;
+    }
+    double aheadTxTime = station->m_stats.txTime[aheadRate];
+    double maxTp2TxTime = station->m_stats.txTime[station->m_maxTpRate2];
+    if (snrAhead < snrNow)
+    {
+        // Receding: fall back to the rate the link will sustain, and sooner
+        if (aheadTxTime > maxTp2TxTime)
+        {
+            station->m_maxTpRate2 = aheadRate;
+        }
+        TARARateInfo& maxTp = station->m_groupsTable[GetGroupId(station->m_maxTpRate)]
+                                  .m_ratesTable[GetRateId(station->m_maxTpRate)];
+        maxTp.retryCount = std::max<uint32_t>(1, maxTp.retryCount / 2);
+    }
+    else if (aheadTxTime < maxTp2TxTime)
+    {
+        // Approaching: the second try can stay at a higher rate
+        station->m_maxTpRate2 = aheadRate;
+    }
+    NS_LOG_DEBUG("Retry chain SNR " << snrNow << " -> " << snrAhead << " dB, max tp2="
+                                    << station->m_maxTpRate2);
+}
+
+void
+TARAWifiManager::UpdatePredictionError(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    uint16_t index = station->m_taraRate;
+    const TARARateInfo& rateInfo =
+        station->m_groupsTable[GetGroupId(index)].m_ratesTable[GetRateId(index)];
+    if (!rateInfo.supported || rateInfo.lastUpdate != station->m_statsUpdates)
+    {
+        // The TARA rate was not attempted in the last interval
+        return;
+    }
+    // The prediction is that the TARA rate is sustainable: every failure at it is an error
+    double error = 1 - station->m_stats.prob[index] / 100;
+    station->m_predictionError =
+        (error * (100 - m_ewmaLevel) + station->m_predictionError * m_ewmaLevel) / 100;
+}
+
+void
+TARAWifiManager::BlendTaraRate(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    uint16_t index = station->m_taraRate;
+    if (index == station->m_maxTpRate)
+    {
+        return;
+    }
+    // Expected throughput of the TARA rate, with the success probability the
+    // prediction claims discounted by the observed prediction error
+    double confidence = 1 - station->m_predictionError;
+    double taraTh =
+        CalculateThroughput(station, GetGroupId(index), GetRateId(index), 100 * confidence);
+    NS_LOG_DEBUG("TARA rate " << index << " confidence " << confidence << " throughput "
+                              << taraTh);
+    if (taraTh > station->m_stats.throughput[station->m_maxTpRate])
+    {
+        station->m_maxTpRate2 = station->m_maxTpRate;
+        station->m_maxTpRate = index;
+        station->m_taraMaxTp = true;
+    }
+    else if (index != station->m_maxTpRate2 &&
+             taraTh > station->m_stats.throughput[station->m_maxTpRate2])
+    {
+        station->m_maxTpRate2 = index;
+    }
+}
+
+/**
+ * Whether a node is moving at the given time.
+ *
+ * \param motion the motion of the node
+ * \param at the time
+ * \returns true if the node is moving
+ */
+static bool
+IsMoving(const TARAMotion& motion, Time at)
+{
+    return at >= motion.start && at < motion.start + motion.duration &&
+           (motion.velocity.x != 0 || motion.velocity.y != 0 || motion.velocity.z != 0);
+}
+
+uint32_t
+TARAWifiManager::GetSamplingBudget(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    TARATrajectory* trajectory = station->m_trajectory;
+    if (trajectory == nullptr || !trajectory->valid)
+    {
+        return SAMPLING_BUDGET_DEFAULT;
+    }
+
+    Time now = Simulator::Now();
+    bool moving = IsMoving(trajectory->local, now) || IsMoving(trajectory->remote, now);
+    if (moving != station->m_moving)
+    {
+        // A node of the link started or stopped moving: the statistics are stale
+        station->m_moving = moving;
+        station->m_samplingBoost = SAMPLING_BOOST_INTERVALS;
+    }
+    double snr = GetPredictedSnr(station, now);
+    double snrDelta = std::abs(snr - station->m_lastPredictedSnr);
+    station->m_lastPredictedSnr = snr;
+
+    if (station->m_samplingBoost > 0)
+    {
+        station->m_samplingBoost--;
+        return SAMPLING_BUDGET_BOOST;
+    }
+    if (snrDelta < SAMPLING_STABLE_SNR_DELTA && station->m_predictionError < SAMPLING_STABLE_ERROR)
+    {
+        return SAMPLING_BUDGET_STABLE;
+    }
+    return SAMPLING_BUDGET_DEFAULT;
+}
+
+Time
+TARAWifiManager::GetSamplingAirtime(Mac48Address peer) const
+{
+    auto it = m_peers.find(peer);
+    return it != m_peers.end() ? it->second.samplingAirtime : Time();
+}
+
+void
+TARAWifiManager::SetTrajectory(Mac48Address peer, const TARAMotion& local, const TARAMotion& remote)
+{
+    NS_LOG_FUNCTION(this << peer);
+    m_peers[peer].trajectory = {true, local, remote};
+}
+
+void
+TARAWifiManager::SetSnrModel(Callback<double, double> model)
+{
+    NS_LOG_FUNCTION(this);
+    m_snrModel = model;
+}
+
+/**
+ * Position of a node at the given time.
+ *
+ * \param motion the motion of the node
+ * \param at the time
+ * \returns the position
+ */
+static Vector
+GetMotionPosition(const TARAMotion& motion, Time at)
+{
+    double t = (Max(Min(at, motion.start + motion.duration), motion.start) - motion.start)
+                   .GetSeconds();
+    return Vector(motion.position.x + motion.velocity.x * t,
+                  motion.position.y + motion.velocity.y * t,
+                  motion.position.z + motion.velocity.z * t);
+}
+
+double
+TARAWifiManager::GetPredictedSnr(TARAWifiRemoteStation* station, Time at)
+{
+    NS_LOG_FUNCTION(this << station << at);
+    return GetModelSnr(station, at) + station->m_snrBias;
+}
+
+double
+TARAWifiManager::GetLowestPredictedSnr(TARAWifiRemoteStation* station, Time from, Time to)
+{
+    NS_LOG_FUNCTION(this << station << from << to);
+    double snr = std::min(GetPredictedSnr(station, from), GetPredictedSnr(station, to));
+    TARATrajectory* trajectory = station->m_trajectory;
+    if (trajectory == nullptr || !trajectory->valid)
+    {
+        return snr;
+    }
+    for (const TARAMotion* motion : {&trajectory->local, &trajectory->remote})
+    {
+        for (Time breakpoint : {motion->start, motion->start + motion->duration})
+        {
+            if (breakpoint > from && breakpoint < to)
+            {
+                snr = std::min(snr, GetPredictedSnr(station, breakpoint));
+            }
+        }
+    }
+    return snr;
+}
+
+double
+TARAWifiManager::GetModelSnr(TARAWifiRemoteStation* station, Time at)
+{
+    NS_LOG_FUNCTION(this << station << at);
+    TARATrajectory* trajectory = station->m_trajectory;
+    if (trajectory == nullptr || !trajectory->valid || m_snrModel.IsNull())
+    {
+        return m_TARASnr;
+    }
+
+    double distance = CalculateDistance(GetMotionPosition(trajectory->local, at),
+                                        GetMotionPosition(trajectory->remote, at));
+    return m_snrModel(distance);
+}
+
+void
+TARAWifiManager::UpdateSnrBias(TARAWifiRemoteStation* station,
+                               double dataSnr,
+                               uint16_t dataChannelWidth)
+{
+    NS_LOG_FUNCTION(this << station << dataSnr << dataChannelWidth);
+    if (!m_snrBiasCorrection || dataSnr <= 0)
+    {
+        return;
+    }
+    // Scalar Kalman filter of the bias, modeled as a random walk, observed
+    // through the residual between the measured and the model SNR. The model
+    // SNR is at the maximum power in a 20 MHz channel: remove the reduction of
+    // the frame's power and the noise of the wider channels.
+    double powerReduction =
+        m_powerControl ? (m_maxPowerLevel - station->m_powerLevel) * m_powerStep : 0;
+    double residual = 10 * std::log10(dataSnr * std::max<uint16_t>(dataChannelWidth, 20) / 20) -
+                      (GetModelSnr(station, Simulator::Now()) - powerReduction);
+    station->m_snrBiasVariance += m_snrBiasProcessNoise;
+    double gain =
+        station->m_snrBiasVariance / (station->m_snrBiasVariance + m_snrBiasMeasurementNoise);
+    station->m_snrBias += gain * (residual - station->m_snrBias);
+    station->m_snrBiasVariance *= 1 - gain;
+    NS_LOG_DEBUG("SNR residual " << residual << " dB, bias " << station->m_snrBias
+                                 << " dB, variance " << station->m_snrBiasVariance);
+}
+
+void
+TARAWifiManager::UpdateRateStats(TARAWifiRemoteStation* station)
+{
+    NS_LOG_FUNCTION(this << station);
+    TARARateStats& stats = station->m_stats;
+    std::size_t nWords = (m_ratesPerfectTxTime.size() + 63) / 64;
+    for (std::size_t word = 0; word < nWords; word++)
+    {
+        uint64_t dirty = stats.dirty[word];
+        if (dirty == 0)
+        {
+            continue;
+        }
+        stats.dirty[word] = 0;
+
+        std::size_t begin = word * 64;
+        std::size_t end = std::min(begin + 64, m_ratesPerfectTxTime.size());
+        UpdateRateStatsKernel(stats, stats.txTime, begin, end, m_ewmaLevel);
+
+        // Bookkeeping, and start of a new interval for the dirty rates
+        for (uint16_t index = begin; dirty != 0; index++, dirty >>= 1)
+        {
+            if ((dirty & 1) == 0)
+            {
+                continue;
+            }
+            if (stats.supported[index] != 0 && stats.numRateAttempt[index] > 0)
+            {
+                TARARateInfo& rate =
+                    station->m_groupsTable[GetGroupId(index)].m_ratesTable[GetRateId(index)];
+                rate.lastUpdate = station->m_statsUpdates;
+                rate.prevNumRateSuccess = stats.numRateSuccess[index];
+                rate.prevNumRateAttempt = stats.numRateAttempt[index];
+                stats.successHist[index] += stats.numRateSuccess[index];
+                stats.attemptHist[index] += stats.numRateAttempt[index];
+            }
+            stats.numRateSuccess[index] = 0;
+            stats.numRateAttempt[index] = 0;
+        }
+    }
+}
+
 double
 TARAWifiManager::CalculateThroughput(TARAWifiRemoteStation* station,
                                            uint8_t groupId,
@@ -1789,14 +3650,14 @@ TARAWifiManager::CalculateThroughput(TARAWifiRemoteStation* station,
          * For the throughput calculation, limit the probability value to 90% to
          * account for collision related packet error rate fluctuation.
          */
-        Time txTime = station->m_groupsTable[groupId].m_ratesTable[rateId].perfectTxTime;
+        double txTime = station->m_stats.txTime[GetIndex(groupId, rateId)];
         if (ewmaProb > 90)
         {
-            return 90 / txTime.GetSeconds();
+            return 90 / txTime;
         }
         else
         {
-            return ewmaProb / txTime.GetSeconds();
+            return ewmaProb / txTime;
         }
     }
 }
@@ -1805,13 +3666,12 @@ void
 TARAWifiManager::SetBestProbabilityRate(TARAWifiRemoteStation* station, uint16_t index)
 {
     GroupInfo* group;
-    TARARateInfo rate;
+    double ewmaProb;
     uint8_t tmpGroupId;
     uint8_t tmpRateId;
     double tmpTh;
     double tmpProb;
     uint8_t groupId;
-    uint8_t rateId;
     double currentTh;
     // maximum group probability (GP) variables
     uint8_t maxGPGroupId;
@@ -1819,18 +3679,17 @@ TARAWifiManager::SetBestProbabilityRate(TARAWifiRemoteStation* station, uint16_t
     double maxGPTh;
 
     groupId = GetGroupId(index);
-    rateId = GetRateId(index);
     group = &station->m_groupsTable[groupId];
-    rate = group->m_ratesTable[rateId];
+    ewmaProb = station->m_stats.ewmaProb[index];
 
     tmpGroupId = GetGroupId(station->m_maxProbRate);
     tmpRateId = GetRateId(station->m_maxProbRate);
-    tmpProb = station->m_groupsTable[tmpGroupId].m_ratesTable[tmpRateId].ewmaProb;
-    tmpTh = station->m_groupsTable[tmpGroupId].m_ratesTable[tmpRateId].throughput;
+    tmpProb = station->m_stats.ewmaProb[GetIndex(tmpGroupId, tmpRateId)];
+    tmpTh = station->m_stats.throughput[GetIndex(tmpGroupId, tmpRateId)];
 
-    if (rate.ewmaProb > 75)
+    if (ewmaProb > 75)
     {
-        currentTh = station->m_groupsTable[groupId].m_ratesTable[rateId].throughput;
+        currentTh = station->m_stats.throughput[index];
         if (currentTh > tmpTh)
         {
             station->m_maxProbRate = index;
@@ -1838,7 +3697,7 @@ TARAWifiManager::SetBestProbabilityRate(TARAWifiRemoteStation* station, uint16_t
 
         maxGPGroupId = GetGroupId(group->m_maxProbRate);
         maxGPRateId = GetRateId(group->m_maxProbRate);
-        maxGPTh = station->m_groupsTable[maxGPGroupId].m_ratesTable[maxGPRateId].throughput;
+        maxGPTh = station->m_stats.throughput[GetIndex(maxGPGroupId, maxGPRateId)];
 
         if (currentTh > maxGPTh)
         {
@@ -1847,12 +3706,11 @@ TARAWifiManager::SetBestProbabilityRate(TARAWifiRemoteStation* station, uint16_t
     }
     else
     {
-        if (rate.ewmaProb > tmpProb)
+        if (ewmaProb > tmpProb)
         {
             station->m_maxProbRate = index;
         }
-        maxGPRateId = GetRateId(group->m_maxProbRate);
-        if (rate.ewmaProb > group->m_ratesTable[maxGPRateId].ewmaProb)
+        if (ewmaProb > station->m_stats.ewmaProb[group->m_maxProbRate])
         {
             group->m_maxProbRate = index;
         }
@@ -1884,18 +3742,18 @@ TARAWifiManager::SetBestStationThRates(TARAWifiRemoteStation* station, uint16_t
 
     groupId = GetGroupId(index);
     rateId = GetRateId(index);
-    prob = station->m_groupsTable[groupId].m_ratesTable[rateId].ewmaProb;
-    th = station->m_groupsTable[groupId].m_ratesTable[rateId].throughput;
+    prob = station->m_stats.ewmaProb[index];
+    th = station->m_stats.throughput[index];
 
     maxTpGroupId = GetGroupId(station->m_maxTpRate);
     maxTpRateId = GetRateId(station->m_maxTpRate);
-    maxTpProb = station->m_groupsTable[maxTpGroupId].m_ratesTable[maxTpRateId].ewmaProb;
-    maxTpTh = station->m_groupsTable[maxTpGroupId].m_ratesTable[maxTpRateId].throughput;
+    maxTpProb = station->m_stats.ewmaProb[GetIndex(maxTpGroupId, maxTpRateId)];
+    maxTpTh = station->m_stats.throughput[GetIndex(maxTpGroupId, maxTpRateId)];
 
     maxTp2GroupId = GetGroupId(station->m_maxTpRate2);
     maxTp2RateId = GetRateId(station->m_maxTpRate2);
-    maxTp2Prob = station->m_groupsTable[maxTp2GroupId].m_ratesTable[maxTp2RateId].ewmaProb;
-    maxTp2Th = station->m_groupsTable[maxTp2GroupId].m_ratesTable[maxTp2RateId].throughput;
+    maxTp2Prob = station->m_stats.ewmaProb[GetIndex(maxTp2GroupId, maxTp2RateId)];
+    maxTp2Th = station->m_stats.throughput[GetIndex(maxTp2GroupId, maxTp2RateId)];
 
     if (th > maxTpTh || (th == maxTpTh && prob > maxTpProb))
     {
@@ -1915,13 +3773,13 @@ TARAWifiManager::SetBestStationThRates(TARAWifiRemoteStation* station, uint16_t
     GroupInfo* group = &station->m_groupsTable[groupId];
     maxTpGroupId = GetGroupId(group->m_maxTpRate);
     maxTpRateId = GetRateId(group->m_maxTpRate);
-    maxTpProb = group->m_ratesTable[maxTpRateId].ewmaProb;
-    maxTpTh = station->m_groupsTable[maxTpGroupId].m_ratesTable[maxTpRateId].throughput;
+    maxTpProb = station->m_stats.ewmaProb[GetIndex(groupId, maxTpRateId)];
+    maxTpTh = station->m_stats.throughput[GetIndex(maxTpGroupId, maxTpRateId)];
 
     maxTp2GroupId = GetGroupId(group->m_maxTpRate2);
     maxTp2RateId = GetRateId(group->m_maxTpRate2);
-    maxTp2Prob = group->m_ratesTable[maxTp2RateId].ewmaProb;
-    maxTp2Th = station->m_groupsTable[maxTp2GroupId].m_ratesTable[maxTp2RateId].throughput;
+    maxTp2Prob = station->m_stats.ewmaProb[GetIndex(groupId, maxTp2RateId)];
+    maxTp2Th = station->m_stats.throughput[GetIndex(maxTp2GroupId, maxTp2RateId)];
 
     if (th > maxTpTh || (th == maxTpTh && prob > maxTpProb))
     {
@@ -1941,7 +3799,10 @@ TARAWifiManager::RateInit(TARAWifiRemoteStation* station)
 {
     NS_LOG_FUNCTION(this << station);
 
-    station->m_groupsTable = McsGroupData(m_numGroups);
+    station->m_groupsTable =
+        CarveGroupsTable(m_stationPool->GetStatsBlock(station), m_numGroups, m_numRates);
+    // Airtimes of PacketLength frames until the MPDU sizes of the station are known
+    std::copy(m_ratesPerfectTxTime.begin(), m_ratesPerfectTxTime.end(), station->m_stats.txTime);
 
     /**
      * Initialize groups supported by the receiver.
@@ -2015,11 +3876,10 @@ TARAWifiManager::RateInit(TARAWifiRemoteStation* station)
             station->m_groupsTable[groupId].m_col = 0;
             station->m_groupsTable[groupId].m_index = 0;
 
-            station->m_groupsTable[groupId].m_ratesTable =
-                TARARate(m_numRates); /// Create the rate list for the group.
             for (uint8_t i = 0; i < m_numRates; i++)
             {
                 station->m_groupsTable[groupId].m_ratesTable[i].supported = false;
+                station->m_stats.supported[GetIndex(groupId, i)] = 0;
             }
 
             // Initialize all modes supported by the remote station that belong to the current
@@ -2061,20 +3921,21 @@ TARAWifiManager::RateInit(TARAWifiRemoteStation* station)
                     NS_LOG_DEBUG("Mode " << +i << ": " << mode);
 
                     station->m_groupsTable[groupId].m_ratesTable[rateId].supported = true;
+                    station->m_stats.supported[GetIndex(groupId, rateId)] = ~0U;
                     station->m_groupsTable[groupId].m_ratesTable[rateId].mcsIndex =
                         i; /// Mapping between rateId and operationalMcsSet
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].numRateAttempt = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].numRateSuccess = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].prob = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].ewmaProb = 0;
+                    station->m_stats.numRateAttempt[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.numRateSuccess[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.prob[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.ewmaProb[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.ewmsdProb[GetIndex(groupId, rateId)] = 0;
                     station->m_groupsTable[groupId].m_ratesTable[rateId].prevNumRateAttempt = 0;
                     station->m_groupsTable[groupId].m_ratesTable[rateId].prevNumRateSuccess = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].numSamplesSkipped = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].successHist = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].attemptHist = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].throughput = 0;
-                    station->m_groupsTable[groupId].m_ratesTable[rateId].perfectTxTime =
-                        GetFirstMpduTxTime(groupId, GetMcsSupported(station, i));
+                    station->m_groupsTable[groupId].m_ratesTable[rateId].lastUpdate =
+                        station->m_statsUpdates;
+                    station->m_stats.successHist[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.attemptHist[GetIndex(groupId, rateId)] = 0;
+                    station->m_stats.throughput[GetIndex(groupId, rateId)] = 0;
                     station->m_groupsTable[groupId].m_ratesTable[rateId].retryCount = 0;
                     station->m_groupsTable[groupId].m_ratesTable[rateId].adjustedRetryCount = 0;
                     CalculateRetransmits(station, groupId, rateId);
@@ -2112,6 +3973,38 @@ TARAWifiManager::CalculateRetransmits(TARAWifiRemoteStation* station,
 {
     NS_LOG_FUNCTION(this << station << +groupId << +rateId);
 
+    TARARateInfo& rateInfo = station->m_groupsTable[groupId].m_ratesTable[rateId];
+    if (station->m_stats.ewmaProb[GetIndex(groupId, rateId)] < 1)
+    {
+        rateInfo.retryCount = 1;
+    }
+    else
+    {
+        rateInfo.retryCount = GetRetryCount(GetIndex(groupId, rateId), station->m_avgAmpduLen);
+        rateInfo.retryUpdated = true;
+    }
+}
+
+uint32_t
+TARAWifiManager::GetRetryCount(uint16_t index, uint32_t avgAmpduLen)
+{
+    NS_LOG_FUNCTION(this << index << avgAmpduLen);
+    // The retry count only depends on the rate, the A-MPDU length and the PHY
+    // timings, so it is computed once per (rate, A-MPDU length) and kept until
+    // the PHY or the MAC are set up again.
+    std::size_t key = index * RETRY_CACHE_AMPDU_LENS + avgAmpduLen;
+    if (avgAmpduLen < RETRY_CACHE_AMPDU_LENS)
+    {
+        if (m_retryCountCache.empty())
+        {
+            m_retryCountCache.assign(m_numGroups * m_numRates * RETRY_CACHE_AMPDU_LENS, 0);
+        }
+        if (m_retryCountCache[key] != 0)
+        {
+            return m_retryCountCache[key];
+        }
+    }
+
     uint32_t cw = 15; // Is an approximation.
     uint32_t cwMax = 1023;
     Time cwTime;
@@ -2119,75 +4012,42 @@ TARAWifiManager::CalculateRetransmits(TARAWifiRemoteStation* station,
     Time dataTxTime;
     Time slotTime = GetPhy()->GetSlot();
     Time ackTime = GetPhy()->GetSifs() + GetPhy()->GetBlockAckTxTime();
+    uint32_t retryCount = 2;
 
-    if (station->m_groupsTable[groupId].m_ratesTable[rateId].ewmaProb < 1)
-    {
-        station->m_groupsTable[groupId].m_ratesTable[rateId].retryCount = 1;
-    }
-    else
+    dataTxTime = m_ratesFirstMpduTxTimeTable[index] + m_ratesTxTimeTable[index] * (avgAmpduLen - 1);
+
+    /* Contention time for first 2 tries */
+    cwTime = (cw / 2) * slotTime;
+    cw = Min((cw + 1) * 2, cwMax);
+    cwTime += (cw / 2) * slotTime;
+    cw = Min((cw + 1) * 2, cwMax);
+
+    /* Total TX time for data and Contention after first 2 tries */
+    txTime = cwTime + 2 * (dataTxTime + ackTime);
+
+    /* See how many more tries we can fit inside segment size */
+    do
     {
-        station->m_groupsTable[groupId].m_ratesTable[rateId].retryCount = 2;
-        station->m_groupsTable[groupId].m_ratesTable[rateId].retryUpdated = true;
-
-        dataTxTime =
-            GetFirstMpduTxTime(
-                groupId,
-                GetMcsSupported(station,
-                                station->m_groupsTable[groupId].m_ratesTable[rateId].mcsIndex)) +
-            GetMpduTxTime(
-                groupId,
-                GetMcsSupported(station,
-                                station->m_groupsTable[groupId].m_ratesTable[rateId].mcsIndex)) *
-                (station->m_avgAmpduLen - 1);
-
-        /* Contention time for first 2 tries */
+        /* Contention time for this try */
         cwTime = (cw / 2) * slotTime;
         cw = Min((cw + 1) * 2, cwMax);
-        cwTime += (cw / 2) * slotTime;
-        cw = Min((cw + 1) * 2, cwMax);
 
-        /* Total TX time for data and Contention after first 2 tries */
-        txTime = cwTime + 2 * (dataTxTime + ackTime);
-
-        /* See how many more tries we can fit inside segment size */
-        do
-        {
-            /* Contention time for this try */
-            cwTime = (cw / 2) * slotTime;
-            cw = Min((cw + 1) * 2, cwMax);
+        /* Total TX time after this try */
+        txTime += cwTime + ackTime + dataTxTime;
+    } while ((txTime < MilliSeconds(6)) && (++retryCount < 7));
 
-            /* Total TX time after this try */
-            txTime += cwTime + ackTime + dataTxTime;
-        } while ((txTime < MilliSeconds(6)) &&
-                 (++station->m_groupsTable[groupId].m_ratesTable[rateId].retryCount < 7));
+    if (avgAmpduLen < RETRY_CACHE_AMPDU_LENS)
+    {
+        m_retryCountCache[key] = retryCount;
     }
-}
-
-double
-TARAWifiManager::CalculateEwmsd(double oldEwmsd,
-                                      double currentProb,
-                                      double ewmaProb,
-                                      double weight)
-{
-    double diff;
-    double incr;
-    double tmp;
-
-    /* calculate exponential weighted moving variance */
-    diff = currentProb - ewmaProb;
-    incr = (100 - weight) * diff / 100;
-    tmp = oldEwmsd * oldEwmsd;
-    tmp = weight * (tmp + diff * incr) / 100;
-
-    /* return standard deviation */
-    return sqrt(tmp);
+    return retryCount;
 }
 
 void
-TARAWifiManager::InitSampleTable(TARAWifiRemoteStation* station)
+TARAWifiManager::InitSampleTable()
 {
-    NS_LOG_FUNCTION(this << station);
-    station->m_col = station->m_index = 0;
+    NS_LOG_FUNCTION(this);
+    m_sampleTable = SampleRate(m_numRates, std::vector<uint8_t>(m_nSampleCol));
 
     // for off-setting to make rates fall between 0 and nModes
     uint8_t numSampleRates = m_numRates;
@@ -2205,11 +4065,11 @@ TARAWifiManager::InitSampleTable(TARAWifiRemoteStation* station)
             newIndex = (i + uv) % numSampleRates;
 
             // this loop is used for filling in other uninitialized places
-            while (station->m_sampleTable[newIndex][col] != 0)
+            while (m_sampleTable[newIndex][col] != 0)
             {
                 newIndex = (newIndex + 1) % m_numRates;
             }
-            station->m_sampleTable[newIndex][col] = i;
+            m_sampleTable[newIndex][col] = i;
         }
     }
 }
@@ -2217,114 +4077,74 @@ TARAWifiManager::InitSampleTable(TARAWifiRemoteStation* station)
 void
 TARAWifiManager::PrintTable(TARAWifiRemoteStation* station)
 {
-    if (!station->m_statsFile.is_open())
+    if (!m_statsRecorder)
     {
         std::ostringstream tmp;
-        tmp << "minstrel-ht-stats-" << station->m_state->m_address << ".txt";
-        station->m_statsFile.open(tmp.str(), std::ios::out);
+        tmp << "minstrel-ht-stats-" << GetMac()->GetAddress() << ".bin";
+        m_statsRecorder = std::make_unique<TARAStatsRecorder>(tmp.str());
     }
-
-    station->m_statsFile
-        << "               best   ____________rate__________    ________statistics________    "
-           "________last_______    ______sum-of________\n"
-        << " mode guard #  rate  [name   idx airtime  max_tp]  [avg(tp) avg(prob) sd(prob)]  "
-           "[prob.|retry|suc|att]  [#success | #attempts]\n";
     for (uint8_t i = 0; i < m_numGroups; i++)
     {
-        StatsDump(station, i, station->m_statsFile);
+        StatsDump(station, i);
     }
-
-    station->m_statsFile << "\nTotal packet count::    ideal "
-                         << Max(0, station->m_totalPacketsCount - station->m_samplePacketsCount)
-                         << "              lookaround " << station->m_samplePacketsCount << "\n";
-    station->m_statsFile << "Average # of aggregated frames per A-MPDU: " << station->m_avgAmpduLen
-                         << "\n\n";
-
-    station->m_statsFile.flush();
 }
 
 void
-TARAWifiManager::StatsDump(TARAWifiRemoteStation* station,
-                                 uint8_t groupId,
-                                 std::ofstream& of)
+TARAWifiManager::StatsDump(TARAWifiRemoteStation* station, uint8_t groupId)
 {
-    uint8_t numRates = m_numRates;
-    McsGroup group = m_minstrelGroups[groupId];
-    Time txTime;
-    for (uint8_t i = 0; i < numRates; i++)
+    if (!station->m_groupsTable[groupId].m_supported)
+    {
+        return;
+    }
+    const McsGroup& group = m_minstrelGroups[groupId];
+
+    // Fields shared by the records of the table
+    TARAStatsRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.time = Simulator::Now().GetNanoSeconds();
+    station->m_state->m_address.CopyTo(record.station);
+    record.group = groupId;
+    record.type = group.type;
+    record.streams = group.streams;
+    record.gi = group.gi;
+    record.chWidth = group.chWidth;
+    record.idealPackets = Max(0, station->m_totalPacketsCount - station->m_samplePacketsCount);
+    record.lookaroundPackets = station->m_samplePacketsCount;
+    record.avgAmpduLen = station->m_avgAmpduLen;
+
+    for (uint8_t i = 0; i < m_numRates; i++)
     {
-        if (station->m_groupsTable[groupId].m_supported &&
-            station->m_groupsTable[groupId].m_ratesTable[i].supported)
+        const TARARateInfo& rateInfo = station->m_groupsTable[groupId].m_ratesTable[i];
+        if (!rateInfo.supported)
         {
-            of << group.type << " " << group.chWidth << "   " << group.gi << "  " << +group.streams
-               << "   ";
-
-            uint16_t maxTpRate = station->m_maxTpRate;
-            uint16_t maxTpRate2 = station->m_maxTpRate2;
-            uint16_t maxProbRate = station->m_maxProbRate;
-
-            uint16_t idx = GetIndex(groupId, i);
-            if (idx == maxTpRate)
-            {
-                of << 'A';
-            }
-            else
-            {
-                of << ' ';
-            }
-            if (idx == maxTpRate2)
-            {
-                of << 'B';
-            }
-            else
-            {
-                of << ' ';
-            }
-            if (idx == maxProbRate)
-            {
-                of << 'P';
-            }
-            else
-            {
-                of << ' ';
-            }
-
-            if (group.type == WIFI_MINSTREL_GROUP_HT)
-            {
-                of << std::setw(4) << "   MCS" << (group.streams - 1) * 8 + i;
-            }
-            else
-            {
-                of << std::setw(7) << "   MCS" << +i << "/" << static_cast<int>(group.streams);
-            }
-
-            of << "  " << std::setw(3) << +idx << "  ";
-
-            /* tx_time[rate(i)] in usec */
-            txTime = GetFirstMpduTxTime(
-                groupId,
-                GetMcsSupported(station, station->m_groupsTable[groupId].m_ratesTable[i].mcsIndex));
-            of << std::setw(6) << txTime.GetMicroSeconds() << "  ";
-
-            of << std::setw(7) << CalculateThroughput(station, groupId, i, 100) / 100 << "   "
-               << std::setw(7) << station->m_groupsTable[groupId].m_ratesTable[i].throughput / 100
-               << "   " << std::setw(7) << station->m_groupsTable[groupId].m_ratesTable[i].ewmaProb
-               << "  " << std::setw(7) << station->m_groupsTable[groupId].m_ratesTable[i].ewmsdProb
-               << "  " << std::setw(7) << station->m_groupsTable[groupId].m_ratesTable[i].prob
-               << "  " << std::setw(2) << station->m_groupsTable[groupId].m_ratesTable[i].retryCount
-               << "   " << std::setw(3)
-               << station->m_groupsTable[groupId].m_ratesTable[i].prevNumRateSuccess << "  "
-               << std::setw(3) << station->m_groupsTable[groupId].m_ratesTable[i].prevNumRateAttempt
-               << "   " << std::setw(9)
-               << station->m_groupsTable[groupId].m_ratesTable[i].successHist << "   "
-               << std::setw(9) << station->m_groupsTable[groupId].m_ratesTable[i].attemptHist
-               << "\n";
+            continue;
         }
+        uint16_t idx = GetIndex(groupId, i);
+        bool lastInterval = rateInfo.lastUpdate == station->m_statsUpdates;
+
+        record.index = idx;
+        record.rate = i;
+        record.flags = (idx == station->m_maxTpRate ? TARA_STATS_MAX_TP : 0) |
+                       (idx == station->m_maxTpRate2 ? TARA_STATS_MAX_TP2 : 0) |
+                       (idx == station->m_maxProbRate ? TARA_STATS_MAX_PROB : 0) |
+                       (lastInterval ? TARA_STATS_LAST_INTERVAL : 0);
+        record.retryCount = rateInfo.retryCount;
+        record.airtime = GetFirstMpduTxTime(groupId, i).GetMicroSeconds();
+        record.successes = lastInterval ? rateInfo.prevNumRateSuccess : 0;
+        record.attempts = lastInterval ? rateInfo.prevNumRateAttempt : 0;
+        record.maxThroughput = CalculateThroughput(station, groupId, i, 100);
+        record.throughput = station->m_stats.throughput[idx];
+        record.ewmaProb = station->m_stats.ewmaProb[idx];
+        record.ewmsdProb = station->m_stats.ewmsdProb[idx];
+        record.prob = station->m_stats.prob[idx];
+        record.successHist = station->m_stats.successHist[idx];
+        record.attemptHist = station->m_stats.attemptHist[idx];
+        m_statsRecorder->Append(record);
     }
 }
 
 uint16_t
-TARAWifiManager::GetIndex(uint8_t groupId, uint8_t rateId)
+TARAWifiManager::GetIndex(uint8_t groupId, uint8_t rateId) const
 {
     NS_LOG_FUNCTION(this << +groupId << +rateId);
     uint16_t index;
@@ -2333,7 +4153,7 @@ TARAWifiManager::GetIndex(uint8_t groupId, uint8_t rateId)
 }
 
 uint8_t
-TARAWifiManager::GetRateId(uint16_t index)
+TARAWifiManager::GetRateId(uint16_t index) const
 {
     NS_LOG_FUNCTION(this << index);
     uint8_t id;
@@ -2342,7 +4162,7 @@ TARAWifiManager::GetRateId(uint16_t index)
 }
 
 uint8_t
-TARAWifiManager::GetGroupId(uint16_t index)
+TARAWifiManager::GetGroupId(uint16_t index) const
 {
     NS_LOG_FUNCTION(this << index);
     return index / m_numRates;
@@ -27,17 +27,24 @@
 
 #include "minstrel-wifi-manager.h"
 
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/traced-callback.h"
+#include "ns3/vector.h"
 #include "ns3/wifi-mpdu-type.h"
 #include "ns3/wifi-remote-station-manager.h"
 
+#include <array>
+#include <map>
+#include <memory>
+
+#ifdef TARA_BENCH_HOOKS
+class TARAManagerBench;
+#endif
+
 namespace ns3
 {
 
-/**
- * Data structure to save transmission time calculations per rate.
- */
-typedef std::map<WifiMode, Time> TxTime;
-
 /**
  * \enum McsGroupType
  * \brief Available MCS group types
@@ -72,11 +79,67 @@ operator<<(std::ostream& os, McsGroupType type)
     }
 }
 
+/**
+ * \enum TARARateReason
+ * \brief What drove a rate decision of TARAWifiManager
+ */
+enum TARARateReason : uint8_t
+{
+    TARA_REASON_TARA = 0,     //!< The TARA rate (override or blending, or first retry).
+    TARA_REASON_MAX_TP,       //!< The Minstrel-HT max throughput rate.
+    TARA_REASON_SAMPLING,     //!< A look-around rate.
+    TARA_REASON_RETRY_CHAIN,  //!< A rate of the retry chain.
+    TARA_REASON_LEGACY,       //!< The legacy Minstrel manager (non-HT stations).
+    TARA_REASON_COUNT         //!< Number of reasons.
+};
+
+/**
+ * \brief Stream insertion operator.
+ *
+ * \param os the stream
+ * \param reason the reason of a rate decision
+ * \returns a reference to the stream
+ */
+inline std::ostream&
+operator<<(std::ostream& os, TARARateReason reason)
+{
+    switch (reason)
+    {
+    case TARA_REASON_TARA:
+        return (os << "TARA");
+    case TARA_REASON_MAX_TP:
+        return (os << "MAX_TP");
+    case TARA_REASON_SAMPLING:
+        return (os << "SAMPLING");
+    case TARA_REASON_RETRY_CHAIN:
+        return (os << "RETRY_CHAIN");
+    case TARA_REASON_LEGACY:
+        return (os << "LEGACY");
+    default:
+        return (os << "INVALID");
+    }
+}
+
+/**
+ * The provenance of a rate decision, reported by the RateDecision trace
+ * source of TARAWifiManager.
+ */
+struct TARARateDecision
+{
+    Mac48Address station;  //!< MAC address of the remote station.
+    uint16_t index;        //!< The chosen rate (global rate index, or legacy rate index).
+    TARARateReason reason; //!< What drove the choice.
+    double predictedSnr;   //!< The SNR predicted for the station (dB).
+    double ewmaProb;       //!< The EWMA of the success probability of the chosen rate (%).
+    Time sinceLastChange;  //!< Time since the rate of the station last changed.
+};
+
 /**
  * Data structure to contain the information that defines a group.
- * It also contains the transmission times for all the MCS in the group.
  * A group is a collection of MCS defined by the number of spatial streams,
  * if it uses or not Short Guard Interval, and the channel width used.
+ * The transmission times of the MCS of all groups are kept by the manager
+ * in flat tables indexed by the global rate index.
  */
 struct McsGroup
 {
@@ -85,10 +148,6 @@ struct McsGroup
     uint16_t chWidth;  ///< channel width (MHz)
     McsGroupType type; ///< identifies the group, \see McsGroupType
     bool isSupported;  ///< flag whether group is  supported
-    // To accurately account for TX times, we separate the TX time of the first
-    // MPDU in an A-MPDU from the rest of the MPDUs.
-    TxTime ratesTxTimeTable;          ///< rates transmit time table
-    TxTime ratesFirstMpduTxTimeTable; ///< rates MPDU transmit time table
 };
 
 /**
@@ -98,47 +157,169 @@ struct McsGroup
 typedef std::vector<McsGroup> MinstrelMcsGroups;
 
 struct TARAWifiRemoteStation;
+class TARAStationPool;
 
 /**
- * A struct to contain all statistics information related to a data rate.
+ * A struct to contain the information related to a data rate. The statistics
+ * updated on every stats interval are kept apart, \see TARARateStats, and the
+ * perfect transmission time of the rate is read from the manager TxTime tables.
  */
 struct TARARateInfo
 {
-    /**
-     * Perfect transmission time calculation, or frame calculation.
-     * Given a bit rate and a packet length n bytes.
-     */
-    Time perfectTxTime;
     bool supported;      //!< If the rate is supported.
     uint8_t mcsIndex;    //!< The index in the operationalMcsSet of the WifiRemoteStationManager.
     uint32_t retryCount; //!< Retry limit.
     uint32_t adjustedRetryCount; //!< Adjust the retry limit for this rate.
-    uint32_t numRateAttempt;     //!< Number of transmission attempts so far.
-    uint32_t numRateSuccess;     //!< Number of successful frames transmitted so far.
-    double prob; //!< Current probability within last time interval. (# frame success )/(# total
-                 //!< frames)
     bool retryUpdated; //!< If number of retries was updated already.
+    uint32_t prevNumRateAttempt; //!< Number of transmission attempts with previous rate
+                                 //!< (valid if lastUpdate is the current stats update).
+    uint32_t prevNumRateSuccess; //!< Number of successful frames transmitted with previous rate
+                                 //!< (valid if lastUpdate is the current stats update).
+    uint32_t lastUpdate; //!< The last stats update with attempts at this rate. The number of
+                         //!< times this rate statistics were not updated because no attempts
+                         //!< have been made is the distance to the current stats update.
+};
+
+/**
+ * The per-rate statistics of a station in structure-of-arrays layout: each
+ * array has an entry per rate of all groups, indexed by the global rate index
+ * (\see TARAWifiManager::GetIndex). The arrays of a station are contiguous and
+ * stored next to the station in the station pool of the manager.
+ */
+struct TARARateStats
+{
+    uint32_t* numRateAttempt; //!< Number of transmission attempts so far.
+    uint32_t* numRateSuccess; //!< Number of successful frames transmitted so far.
+    double* prob; //!< Current probability within last time interval. (# frame success )/(# total
+                  //!< frames)
     /**
      * Exponential weighted moving average of probability.
      * EWMA calculation:
      * ewma_prob =[prob *(100 - ewma_level) + (ewma_prob_old * ewma_level)]/100
      */
-    double ewmaProb;
-    double ewmsdProb;            //!< Exponential weighted moving standard deviation of probability.
-    uint32_t prevNumRateAttempt; //!< Number of transmission attempts with previous rate.
-    uint32_t prevNumRateSuccess; //!< Number of successful frames transmitted with previous rate.
-    uint32_t numSamplesSkipped;  //!< Number of times this rate statistics were not updated because
-                                 //!< no attempts have been made.
-    uint64_t successHist;        //!< Aggregate of all transmission successes.
-    uint64_t attemptHist;        //!< Aggregate of all transmission attempts.
-    double throughput;           //!< Throughput of this rate (in packets per second).
+    double* ewmaProb;
+    double* ewmsdProb;  //!< Exponential weighted moving standard deviation of probability.
+    double* throughput; //!< Throughput of this rate (in packets per second).
+    double* txTime;     //!< Airtime of an MPDU at this rate for the MPDU sizes and A-MPDU
+                        //!< length of the station (seconds), \see UpdateAirtimes
+    uint64_t* successHist; //!< Aggregate of all transmission successes.
+    uint64_t* attemptHist; //!< Aggregate of all transmission attempts.
+    uint32_t* supported;   //!< All bits set if the rate is supported by the station, 0 otherwise.
+    uint64_t* dirty;       //!< Bitmap of the rates attempted since the last stats update.
 };
 
+static const char TARA_STATS_MAGIC[8] = {'T', 'A', 'R', 'A', 'S', 'T', 'A', 'T'}; //!< File magic
+static const uint32_t TARA_STATS_VERSION = 1; //!< Version of the statistics file layout.
+
+static const uint8_t TARA_STATS_MAX_TP = 0x01;   //!< Record flag of the max throughput rate (A).
+static const uint8_t TARA_STATS_MAX_TP2 = 0x02;  //!< Record flag of the second max tp rate (B).
+static const uint8_t TARA_STATS_MAX_PROB = 0x04; //!< Record flag of the max probability rate (P).
+static const uint8_t TARA_STATS_LAST_INTERVAL =
+    0x08; //!< Record flag set if the rate was attempted in the last stats interval.
+
 /**
- * Data structure for a Minstrel Rate table.
- * A vector of a struct TARARateInfo.
+ * Header of the binary statistics file written when the PrintStats attribute
+ * is set. It is followed by nRecords records of type TARAStatsRecord.
  */
-typedef std::vector<TARARateInfo> TARARate;
+struct TARAStatsFileHeader
+{
+    char magic[8];       //!< TARA_STATS_MAGIC.
+    uint32_t version;    //!< TARA_STATS_VERSION.
+    uint32_t recordSize; //!< Size of a record (bytes).
+    uint64_t nRecords;   //!< Number of records in the file.
+};
+
+/**
+ * Fixed-width record of the binary statistics file: one record per supported
+ * rate of a station on every stats update. The records of a statistics table
+ * are consecutive and share the time and station fields, and repeat the
+ * per-station counters (idealPackets, lookaroundPackets and avgAmpduLen).
+ * The tools/tara-stats-decode program prints the records as text tables or CSV.
+ */
+struct TARAStatsRecord
+{
+    int64_t time;               //!< Time of the stats update (nanoseconds).
+    uint8_t station[6];         //!< MAC address of the station.
+    uint16_t index;             //!< Global rate index.
+    uint8_t group;              //!< Group ID.
+    uint8_t rate;               //!< Rate ID within the group.
+    uint8_t type;               //!< McsGroupType of the group.
+    uint8_t streams;            //!< Number of spatial streams of the group.
+    uint16_t gi;                //!< Guard interval of the group (nanoseconds).
+    uint16_t chWidth;           //!< Channel width of the group (MHz).
+    uint8_t flags;              //!< TARA_STATS_MAX_TP, TARA_STATS_MAX_TP2, ... flags.
+    uint8_t retryCount;         //!< Retry count of the rate.
+    uint16_t reserved;          //!< Padding, set to 0.
+    uint32_t airtime;           //!< Transmission time of the first MPDU (microseconds).
+    uint32_t successes;         //!< Successes in the last interval.
+    uint32_t attempts;          //!< Attempts in the last interval.
+    uint32_t idealPackets;      //!< Packets of the station sent at the best rates.
+    uint32_t lookaroundPackets; //!< Packets of the station sent for sampling.
+    uint32_t avgAmpduLen;       //!< Average number of MPDUs per A-MPDU of the station.
+    uint32_t reserved2;         //!< Padding, set to 0.
+    double maxThroughput;       //!< Throughput of the rate at 100% success.
+    double throughput;          //!< Throughput of the rate.
+    double ewmaProb;            //!< EWMA of the success probability.
+    double ewmsdProb;           //!< EWMSD of the success probability.
+    double prob;                //!< Success probability in the last interval.
+    uint64_t successHist;       //!< Aggregate of all transmission successes.
+    uint64_t attemptHist;       //!< Aggregate of all transmission attempts.
+};
+
+static_assert(sizeof(TARAStatsFileHeader) == 24, "statistics file header layout");
+static_assert(sizeof(TARAStatsRecord) == 112, "statistics record layout");
+
+static const char TARA_TRACE_MAGIC[8] = {'T', 'A', 'R', 'A', 'T', 'R', 'C', 'E'}; //!< File magic
+static const uint32_t TARA_TRACE_VERSION = 1; //!< Version of the tracepoint file layout.
+
+/**
+ * \enum TARATraceEventType
+ * \brief Rate-control decisions recorded by the tracepoints of TARAWifiManager
+ */
+enum TARATraceEventType : uint8_t
+{
+    TARA_TRACE_TARA_RATE = 0, //!< The TARA rate changed (snr is the predicted SNR).
+    TARA_TRACE_STATS_UPDATE,  //!< The max throughput rate was reselected (value: max tp2, max
+                              //!< prob rates).
+    TARA_TRACE_SAMPLE,        //!< A look-around rate was picked (old rate: max tp rate; value:
+                              //!< sample tries left).
+    TARA_TRACE_RETRY,         //!< A rate was picked from the retry chain (value: long retry
+                              //!< count, 1 if sampling).
+};
+
+/**
+ * Header of the binary file written by TARAWifiManager::DumpTracepoints. It is
+ * followed by nEvents events of type TARATraceEvent, oldest first.
+ */
+struct TARATraceFileHeader
+{
+    char magic[8];       //!< TARA_TRACE_MAGIC.
+    uint32_t version;    //!< TARA_TRACE_VERSION.
+    uint32_t recordSize; //!< Size of an event (bytes).
+    uint64_t nEvents;    //!< Number of events in the file.
+};
+
+/**
+ * Fixed-width event of the tracepoint ring of a TARAWifiManager. The
+ * tools/tara-trace-decode program prints the events of a dump as text or CSV.
+ */
+struct TARATraceEvent
+{
+    int64_t time;       //!< Time of the event (nanoseconds).
+    uint8_t station[6]; //!< MAC address of the station.
+    uint8_t type;       //!< TARATraceEventType.
+    uint8_t reserved;   //!< Padding, set to 0.
+    uint16_t oldRate;   //!< Global rate index before the decision.
+    uint16_t newRate;   //!< Global rate index after the decision.
+    float snr;          //!< Predicted SNR (dB) of TARA_TRACE_TARA_RATE events, 0 otherwise.
+    uint32_t value[2];  //!< Event specific values, \see TARATraceEventType.
+};
+
+static_assert(sizeof(TARATraceFileHeader) == 24, "tracepoint file header layout");
+static_assert(sizeof(TARATraceEvent) == 32, "tracepoint event layout");
+
+class TARAStatsRecorder;
+struct TARASnrCacheKey;
 
 /**
  * A struct to contain information of a group.
@@ -154,15 +335,10 @@ struct GroupInfo
     uint16_t m_maxTpRate;        //!< The max throughput rate of this group in bps.
     uint16_t m_maxTpRate2;       //!< The second max throughput rate of this group in bps.
     uint16_t m_maxProbRate;      //!< The highest success probability rate of this group in bps.
-    TARARate m_ratesTable; //!< Information about rates of this group.
+    TARARateInfo* m_ratesTable;  //!< Information about rates of this group, stored in the
+                                 //!< statistics block of the station.
 };
 
-/**
- * Data structure for a table of groups. Each group is of type GroupInfo.
- * A vector of a GroupInfo.
- */
-typedef std::vector<struct GroupInfo> McsGroupData;
-
 /**
  * Constants for maximum values.
  */
@@ -188,6 +364,75 @@ static const uint8_t MAX_HE_GROUP_RATES = 12;  //!< Number of rates (or MCS) per
 static const uint8_t MAX_HT_WIDTH = 40;        //!< Maximal channel width in MHz.
 static const uint8_t MAX_VHT_WIDTH = 160;      //!< Maximal channel width in MHz.
 static const uint8_t MAX_HE_WIDTH = 160;       //!< Maximal channel width in MHz.
+static const uint16_t MAX_MCS_GROUPS =
+    MAX_HT_SUPPORTED_STREAMS * MAX_HT_STREAM_GROUPS +
+    MAX_VHT_SUPPORTED_STREAMS * MAX_VHT_STREAM_GROUPS +
+    MAX_HE_SUPPORTED_STREAMS * MAX_HE_STREAM_GROUPS; //!< Maximal number of HT, VHT and HE groups.
+
+/**
+ * Data structure to save transmission time calculations per rate,
+ * indexed by the global rate index (see TARAWifiManager::GetIndex).
+ */
+typedef std::array<Time, MAX_MCS_GROUPS * MAX_HE_GROUP_RATES> TxTime;
+
+/**
+ * Dimensions of the dense SNR threshold table, indexed by
+ * (modulation class, MCS, number of streams, channel width).
+ */
+static const uint8_t SNR_TABLE_MOD_CLASSES = 3; //!< HT, VHT and HE modulation classes.
+static const uint8_t SNR_TABLE_MCS = MAX_HE_GROUP_RATES; //!< MCS per stream (HT MCS modulo 8).
+static const uint8_t SNR_TABLE_STREAMS = MAX_HE_SUPPORTED_STREAMS; //!< Number of spatial streams.
+static const uint8_t SNR_TABLE_WIDTHS = 4;      //!< 20, 40, 80 and 160 MHz.
+static const uint16_t SNR_TABLE_SIZE =
+    SNR_TABLE_MOD_CLASSES * SNR_TABLE_MCS * SNR_TABLE_STREAMS *
+    SNR_TABLE_WIDTHS; //!< Number of entries of the dense SNR threshold table.
+
+static const uint8_t TARA_MPDU_SIZE_CLASSES = 4; //!< MPDU size classes of the airtime tables.
+
+/**
+ * Number of MPDUs sent to a peer in each MPDU size class since the last stats
+ * update of the peer.
+ */
+typedef std::array<uint32_t, TARA_MPDU_SIZE_CLASSES> TARAMpduSizes;
+
+/**
+ * Motion of a node as predicted by TARA: from its position at the start time,
+ * the node moves at a constant velocity for the flight duration, then stays still.
+ */
+struct TARAMotion
+{
+    Vector position; //!< Position at the start time (m).
+    Vector velocity; //!< Velocity during the flight (m/s).
+    Time start;      //!< Time of the position.
+    Time duration;   //!< Flight duration.
+};
+
+/**
+ * Predicted trajectories of the two ends of the link with a peer.
+ */
+struct TARATrajectory
+{
+    bool valid;        //!< If the trajectories were set.
+    TARAMotion local;  //!< Motion of the node of this device.
+    TARAMotion remote; //!< Motion of the peer.
+};
+
+/**
+ * State of the link with a peer that is kept by the manager rather than by the
+ * remote station: it may be set before the association, and it outlives
+ * reassociations.
+ */
+struct TARAPeer
+{
+    TARATrajectory trajectory; //!< Predicted trajectories of the link.
+    Time samplingAirtime;      //!< Airtime spent sampling with the peer.
+    TARAMpduSizes mpduSizes;   //!< MPDUs sent to the peer by size class (\see NotifyMpduSize).
+};
+
+/**
+ * Data structure for the link state of all peers, by peer address.
+ */
+typedef std::map<Mac48Address, TARAPeer> TARAPeers;
 
 /**
  * \brief Implementation of Minstrel-HT Rate Control Algorithm
@@ -256,7 +501,76 @@ class TARAWifiManager : public WifiRemoteStationManager
      */
     typedef void (*RateChangeTracedCallback)(const uint64_t rate, const Mac48Address remoteAddress);
 
+    /**
+     * TracedCallback signature for the retry statistics of a remote station.
+     *
+     * \param [in] remoteAddress The remote station MAC address.
+     * \param [in] retries The number of retransmissions so far.
+     * \param [in] dropped The number of frames dropped so far.
+     */
+    typedef void (*RetryStatsTracedCallback)(const Mac48Address remoteAddress,
+                                             uint32_t retries,
+                                             uint32_t dropped);
+
+    /**
+     * TracedCallback signature for the rate decisions.
+     *
+     * \param [in] decision The provenance of the decision.
+     */
+    typedef void (*RateDecisionTracedCallback)(const TARARateDecision& decision);
+
+    /**
+     * Return how many rate decisions had the given reason, over all the
+     * stations. The counters do not need a sink on the RateDecision trace.
+     *
+     * \param reason the reason
+     * \returns the number of decisions
+     */
+    uint64_t GetDecisionCount(TARARateReason reason) const;
+
+    /**
+     * Set the predicted trajectories of the link with the given peer, replacing
+     * the previous ones. The SNR of the link is evaluated from them, with the SNR
+     * model, whenever the TARA rate of the peer is updated.
+     *
+     * \param peer the MAC address of the remote station
+     * \param local the motion of the node of this device
+     * \param remote the motion of the peer
+     */
+    void SetTrajectory(Mac48Address peer, const TARAMotion& local, const TARAMotion& remote);
+
+    /**
+     * Set the model giving the SNR (dB) of a link from the distance (m) between
+     * its two ends, used to evaluate the SNR of the peers with a trajectory.
+     *
+     * \param model the SNR model
+     */
+    void SetSnrModel(Callback<double, double> model);
+
+    /**
+     * Return the airtime spent so far sampling rates with the given peer.
+     *
+     * \param peer the MAC address of the remote station
+     * \returns the sampling airtime
+     */
+    Time GetSamplingAirtime(Mac48Address peer) const;
+
+    /**
+     * Write the events of the tracepoint ring (the last TraceEvents rate-control
+     * decisions of all the stations) in a binary file, oldest first. The file
+     * is decoded with tools/tara-trace-decode.
+     *
+     * \param fileName the name of the file
+     */
+    void DumpTracepoints(const std::string& fileName) const;
+
   private:
+#ifdef TARA_BENCH_HOOKS
+    /// Runs FindRate and UpdateStats on the stations directly (bench/manager-bench.cc)
+    friend class ::TARAManagerBench;
+#endif
+
+    void DoDispose() override;
     void DoInitialize() override;
     WifiRemoteStation* DoCreateStation() const override;
     void DoReportRxOk(WifiRemoteStation* station, double rxSnr, WifiMode txMode) override;
@@ -295,30 +609,85 @@ class TARAWifiManager : public WifiRemoteStationManager
     uint16_t GetChannelWidthForNonHtMode(WifiMode mode) const;
 
     /**
-     * Construct the vector of minimum SNRs needed to successfully transmit for
+     * Construct the table of minimum SNRs needed to successfully transmit for
      * all possible combinations (rate, channel width, nss) based on PHY capabilities.
-     * This is called at initialization and if PHY capabilities changed.
+     * This is called at initialization.
      */
     void BuildSnrThresholds();
 
-        /**
+    /**
+     * \returns what the SNR thresholds of the device depend on
+     */
+    TARASnrCacheKey GetSnrCacheKey();
+
+    /**
+     * Load the SNR thresholds from a cache file, if it exists and is valid
+     * for the given key.
+     *
+     * \param fileName the name of the cache file
+     * \param key what the SNR thresholds of the device depend on
+     * \returns true if the SNR thresholds were loaded
+     */
+    bool LoadSnrThresholds(const std::string& fileName, const TARASnrCacheKey& key);
+
+    /**
+     * Save the SNR thresholds in a cache file.
+     *
+     * \param fileName the name of the cache file
+     * \param key what the SNR thresholds of the device depend on
+     */
+    void SaveSnrThresholds(const std::string& fileName, const TARASnrCacheKey& key);
+
+    /**
+     * Build the per-group tables of the minimum SNRs of the rates of the
+     * supported groups, sorted by increasing SNR, for the TARA rate search.
+     * The SNRs are referred to the noise of a 20 MHz channel, as predicted by
+     * the SNR model: the noise of wider channels is higher.
+     * This is called at initialization, once the groups are known.
+     */
+    void BuildGroupSnrThresholds();
+
+    /**
      * Return the minimum SNR needed to successfully transmit
      * data with this WifiTxVector at the specified BER.
      *
+     * This is a constant-time read of the dense threshold table. If the entry
+     * is missing (capabilities have changed at runtime), only that entry is
+     * computed and stored.
+     *
      * \param txVector WifiTxVector (containing valid mode, width, and Nss)
      *
      * \return the minimum SNR for the given WifiTxVector in linear scale
      */
     double GetSnrThreshold(WifiTxVector txVector);
+
     /**
-     * Adds a pair of WifiTxVector and the minimum SNR for that given vector
-     * to the list.
+     * Store the minimum SNR for the given WifiTxVector in the threshold table.
      *
      * \param txVector the WifiTxVector storing mode, channel width, and Nss
      * \param snr the minimum SNR for the given txVector in linear scale
      */
     void AddSnrThreshold(WifiTxVector txVector, double snr);
 
+    /**
+     * Return the position in the dense SNR threshold table of the given HT, VHT
+     * or HE WifiTxVector. For HT modes, the number of streams is derived from the
+     * MCS index.
+     *
+     * \param txVector the WifiTxVector storing mode, channel width, and Nss
+     * \return the index in m_snrThresholds
+     */
+    uint16_t GetSnrThresholdIndex(const WifiTxVector& txVector) const;
+
+    /**
+     * Return a pointer to the threshold table entry of the given WifiTxVector.
+     * Non-HT modes are stored in a separate table indexed by mode UID.
+     *
+     * \param txVector the WifiTxVector storing mode, channel width, and Nss
+     * \return a pointer to the entry holding the minimum SNR in linear scale
+     */
+    double* GetSnrThresholdEntry(const WifiTxVector& txVector);
+
     /**
      * Check the validity of a combination of number of streams, chWidth and mode.
      *
@@ -350,40 +719,88 @@ class TARAWifiManager : public WifiRemoteStationManager
                                  MpduType mpduType);
 
     /**
-     * Obtain the TxTime saved in the group information.
+     * Estimates the TxTime of a frame of the given size with a given mode and
+     * group (stream, guard interval and channel width).
      *
-     * \param groupId the group ID
+     * \param phy pointer to the wifi PHY
+     * \param streams the number of streams
+     * \param gi guard interval duration (nanoseconds)
+     * \param chWidth the channel width (MHz)
      * \param mode the wifi mode
+     * \param mpduType the type of the MPDU
+     * \param length the size of the frame (bytes)
      * \returns the transmit time
      */
-    Time GetMpduTxTime(uint8_t groupId, WifiMode mode) const;
+    Time CalculateMpduTxDuration(Ptr<WifiPhy> phy,
+                                 uint8_t streams,
+                                 uint16_t gi,
+                                 uint16_t chWidth,
+                                 WifiMode mode,
+                                 MpduType mpduType,
+                                 uint32_t length);
 
     /**
-     * Save a TxTime to the vector of groups.
+     * Fill the airtime tables of the MPDU size classes for a rate of a group.
      *
      * \param groupId the group ID
-     * \param mode the wifi mode
+     * \param rateId the rate ID
+     * \param mode the wifi mode of the rate
+     */
+    void AddSizeClassTxTimes(uint8_t groupId, uint8_t rateId, WifiMode mode);
+
+    /**
+     * Count an acknowledged or unacknowledged MPDU in the size class
+     * distribution of its receiver.
+     *
+     * \param mpdu the MPDU
+     */
+    void NotifyMpduSize(Ptr<const WifiMpdu> mpdu);
+
+    /**
+     * Update the MPDU size distribution of the station with the MPDUs sent
+     * since the last stats update, and the airtimes of its rates (and the
+     * throughputs computed with them) with that distribution and the average
+     * A-MPDU length of the station.
+     *
+     * \param station the TARA wifi remote station
+     */
+    void UpdateAirtimes(TARAWifiRemoteStation* station);
+
+    /**
+     * Obtain the TxTime saved in the flat transmit time table.
+     *
+     * \param groupId the group ID
+     * \param rateId the rate ID
+     * \returns the transmit time
+     */
+    Time GetMpduTxTime(uint8_t groupId, uint8_t rateId) const;
+
+    /**
+     * Save a TxTime to the flat transmit time table.
+     *
+     * \param groupId the group ID
+     * \param rateId the rate ID
      * \param t the transmit time
      */
-    void AddMpduTxTime(uint8_t groupId, WifiMode mode, Time t);
+    void AddMpduTxTime(uint8_t groupId, uint8_t rateId, Time t);
 
     /**
-     * Obtain the TxTime saved in the group information.
+     * Obtain the TxTime of the first MPDU of an A-MPDU saved in the flat transmit time table.
      *
      * \param groupId the group ID
-     * \param mode the wifi mode
+     * \param rateId the rate ID
      * \returns the transmit time
      */
-    Time GetFirstMpduTxTime(uint8_t groupId, WifiMode mode) const;
+    Time GetFirstMpduTxTime(uint8_t groupId, uint8_t rateId) const;
 
     /**
-     * Save a TxTime to the vector of groups.
+     * Save a TxTime of the first MPDU of an A-MPDU to the flat transmit time table.
      *
      * \param groupId the group ID
-     * \param mode the wifi mode
+     * \param rateId the rate ID
      * \param t the transmit time
      */
-    void AddFirstMpduTxTime(uint8_t groupId, WifiMode mode, Time t);
+    void AddFirstMpduTxTime(uint8_t groupId, uint8_t rateId, Time t);
 
     /**
      * Update the number of retries and reset accordingly.
@@ -432,6 +849,52 @@ class TARAWifiManager : public WifiRemoteStationManager
      */
     void UpdateStats(TARAWifiRemoteStation* station);
 
+    /**
+     * Update the statistics of all the HT stations whose period has elapsed,
+     * walking the station pool in memory order, and schedule the next period.
+     * Runs every UpdateStatistics when BatchedStatsUpdate is set, instead of
+     * UpdateStats being called from the feedback of each frame.
+     */
+    void UpdateDueStats();
+
+#ifdef TARA_BENCH_HOOKS
+    /**
+     * \param address the address of a station
+     * \returns the station of the pool with this address, nullptr if none
+     */
+    TARAWifiRemoteStation* GetPooledStation(Mac48Address address) const;
+#endif
+
+    /**
+     * Account for a rate decision, and report its provenance to the
+     * RateDecision trace sinks, if any.
+     *
+     * \param station the TARA wifi remote station
+     * \param index the chosen rate
+     * \param reason what drove the choice
+     */
+    void RecordDecision(TARAWifiRemoteStation* station, uint16_t index, TARARateReason reason);
+
+    /**
+     * Record a rate-control decision in the tracepoint ring, overwriting the
+     * oldest event once the ring is full.
+     *
+     * \param station the TARA wifi remote station
+     * \param type the TARATraceEventType
+     * \param oldRate the global rate index before the decision
+     * \param newRate the global rate index after the decision
+     * \param value0 the first event specific value
+     * \param value1 the second event specific value
+     * \param snr the predicted SNR (dB)
+     */
+    void Tracepoint(const TARAWifiRemoteStation* station,
+                    uint8_t type,
+                    uint16_t oldRate,
+                    uint16_t newRate,
+                    uint32_t value0 = 0,
+                    uint32_t value1 = 0,
+                    float snr = 0);
+
     /**
      * Initialize Minstrel Table.
      *
@@ -488,6 +951,17 @@ class TARAWifiManager : public WifiRemoteStationManager
                               uint8_t groupId,
                               uint8_t rateId);
 
+    /**
+     * Get the number of retransmissions that fit in 6 ms at the given rate with
+     * the given A-MPDU length. The result is memoized per (rate, A-MPDU length)
+     * until the PHY or the MAC are set up again.
+     *
+     * \param index the global rate index
+     * \param avgAmpduLen the average number of MPDUs per A-MPDU
+     * \returns the retry count (between 2 and 7)
+     */
+    uint32_t GetRetryCount(uint16_t index, uint32_t avgAmpduLen);
+
     /**
      * Estimate the time to transmit the given packet with the given number of retries.
      * This function is "roughly" the function "calc_usecs_unicast_packet" in minstrel.c
@@ -514,45 +988,34 @@ class TARAWifiManager : public WifiRemoteStationManager
                                     uint32_t longRetries);
 
     /**
-     * Perform EWMSD (Exponentially Weighted Moving Standard Deviation) calculation.
-     *
-     * \param oldEwmsd the old EWMSD
-     * \param currentProb the current probability
-     * \param ewmaProb the EWMA probability
-     * \param weight the weight
-     * \returns the EWMSD
-     */
-    double CalculateEwmsd(double oldEwmsd, double currentProb, double ewmaProb, double weight);
-
-    /**
-     * Initialize Sample Table.
+     * Update the success probability, its EWMA and EWMSD, and the throughput of
+     * the rates of the station that have been attempted since the last update
+     * (the dirty rates), then start a new interval for them. The statistics of
+     * the other rates are left as they are.
      *
      * \param station the Minstrel-HT wifi remote station
      */
-    void InitSampleTable(TARAWifiRemoteStation* station);
+    void UpdateRateStats(TARAWifiRemoteStation* station);
 
     /**
-     * Printing Sample Table.
-     *
-     * \param station the Minstrel-HT wifi remote station
+     * Initialize the Sample Table shared by all the HT stations.
      */
-    void PrintSampleTable(TARAWifiRemoteStation* station);
+    void InitSampleTable();
 
     /**
-     * Printing Minstrel Table.
+     * Record the statistics table of a station in the statistics file.
      *
      * \param station the Minstrel-HT wifi remote station
      */
     void PrintTable(TARAWifiRemoteStation* station);
 
     /**
-     * Print group statistics.
+     * Record the statistics of the supported rates of a group.
      *
      * \param station the Minstrel-HT wifi remote station
      * \param groupId the group ID
-     * \param of the output file stream
      */
-    void StatsDump(TARAWifiRemoteStation* station, uint8_t groupId, std::ofstream& of);
+    void StatsDump(TARAWifiRemoteStation* station, uint8_t groupId);
 
     /**
      * Check for initializations.
@@ -582,7 +1045,7 @@ class TARAWifiManager : public WifiRemoteStationManager
      * \param index the index
      * \returns the rate ID
      */
-    uint8_t GetRateId(uint16_t index);
+    uint8_t GetRateId(uint16_t index) const;
 
     /**
      * Return the groupId from the global index.
@@ -590,7 +1053,7 @@ class TARAWifiManager : public WifiRemoteStationManager
      * \param index the index
      * \returns the group ID
      */
-    uint8_t GetGroupId(uint16_t index);
+    uint8_t GetGroupId(uint16_t index) const;
 
     /**
      * Returns the global index corresponding to the groupId and rateId.
@@ -603,7 +1066,7 @@ class TARAWifiManager : public WifiRemoteStationManager
      * \param rateId the rate ID
      * \returns the index
      */
-    uint16_t GetIndex(uint8_t groupId, uint8_t rateId);
+    uint16_t GetIndex(uint8_t groupId, uint8_t rateId) const;
 
     /**
      * Returns the groupId of an HT MCS with the given number of streams, GI and channel width used.
@@ -686,9 +1149,139 @@ class TARAWifiManager : public WifiRemoteStationManager
      */
     uint16_t UpdateRateAfterAllowedWidth(uint16_t txRate, uint16_t allowedWidth);
 
+    /**
+     * Return the trajectory-predicted SNR of the station at the given time:
+     * the SNR model evaluated at the distance between the two ends of the link.
+     * If no trajectory was set for this peer (or no SNR model), the device-wide
+     * TARASnr attribute is used. The bias learnt from the acknowledgments of
+     * the station is added (\see UpdateSnrBias).
+     *
+     * \param station the TARA wifi remote station
+     * \param at the time
+     * \returns the predicted SNR (dB)
+     */
+    double GetPredictedSnr(TARAWifiRemoteStation* station, Time at);
+
+    /**
+     * Return the lowest SNR predicted for a peer over a time window. Each node
+     * moves linearly from the start to the end of its motion and stands still
+     * outside it, so the distance between the nodes is convex between these
+     * breakpoints, and largest at an end of each piece. As the SNR model
+     * decreases with the distance, the lowest SNR is at an end of the window
+     * or at a breakpoint inside it.
+     *
+     * \param station the TARA wifi remote station
+     * \param from the start of the window
+     * \param to the end of the window
+     * \returns the lowest predicted SNR (dB)
+     */
+    double GetLowestPredictedSnr(TARAWifiRemoteStation* station, Time from, Time to);
+
+    /**
+     * Return the SNR of the station at the given time as given by the
+     * trajectory and the SNR model (or the TARASnr attribute), without the
+     * bias correction of \see UpdateSnrBias.
+     *
+     * \param station the TARA wifi remote station
+     * \param at the time
+     * \returns the SNR of the model (dB)
+     */
+    double GetModelSnr(TARAWifiRemoteStation* station, Time at);
+
+    /**
+     * Update the estimate of the bias of the SNR model of the station with
+     * the SNR of a data frame reported by the station, if SnrBiasCorrection
+     * is set.
+     *
+     * \param station the TARA wifi remote station
+     * \param dataSnr the SNR of the data frame measured by the station (linear)
+     * \param dataChannelWidth the channel width of the data frame (MHz)
+     */
+    void UpdateSnrBias(TARAWifiRemoteStation* station, double dataSnr, uint16_t dataChannelWidth);
+
+    /**
+     * Return the power level of a data frame to the station at the given rate.
+     * With PowerControl, it is the lowest level at which the SNR predicted
+     * until the next stats update stays PowerMargin above the minimum SNR of
+     * the rate, or the maximum level if the station has no trajectory.
+     * Otherwise, it is the default power level.
+     *
+     * \param station the TARA wifi remote station
+     * \param index the global rate index
+     * \returns the power level
+     */
+    uint8_t GetTxPowerLevel(TARAWifiRemoteStation* station, uint16_t index);
+
+    /**
+     * Select the TARA rate of the station: the rate, among all the groups
+     * supported by the station (any number of streams, channel width and guard
+     * interval), with the highest throughput whose minimum SNR is below the
+     * trajectory-predicted SNR. Channels wider than 20 MHz must also be
+     * sustained by the SNR predicted WidthLookahead ahead. If no rate
+     * qualifies, the max probability rate is used.
+     *
+     * \param station the TARA wifi remote station
+     */
+    void UpdateTaraRate(TARAWifiRemoteStation* station);
+
+    /**
+     * Return the rate with the highest throughput, among all the groups
+     * supported by the station, whose minimum SNR is below the given SNR, or
+     * the max probability rate if none.
+     *
+     * \param station the TARA wifi remote station
+     * \param snr the SNR in a 20 MHz channel (linear scale)
+     * \param wideSnr the SNR in a 20 MHz channel (linear scale) against which
+     *        the rates of the groups wider than 20 MHz are selected
+     * \returns the global rate index
+     */
+    uint16_t GetSnrRate(TARAWifiRemoteStation* station, double snr, double wideSnr);
+
+    /**
+     * Adjust the retry chain of the station to the SNR predicted RetryLookahead
+     * ahead: on a receding link, the second try falls back to the rate the link
+     * will sustain and the first rate is tried half as many times; on an
+     * approaching link, the second try uses that rate if it is faster.
+     *
+     * \param station the TARA wifi remote station
+     */
+    void UpdateRetryChain(TARAWifiRemoteStation* station);
+
+    /**
+     * Update the prediction error of the station with the success probability
+     * of its TARA rate in the last interval, if the rate was attempted. The TARA
+     * rate is predicted to be sustainable, so the error is its failure ratio.
+     *
+     * \param station the TARA wifi remote station
+     */
+    void UpdatePredictionError(TARAWifiRemoteStation* station);
+
+    /**
+     * Weight the TARA rate against the max throughput rates of Minstrel: its
+     * throughput is estimated with a success probability of one minus the
+     * prediction error of the station, and it takes the place of the first max
+     * throughput rate it beats.
+     *
+     * \param station the TARA wifi remote station
+     */
+    void BlendTaraRate(TARAWifiRemoteStation* station);
+
+    /**
+     * Return the number of samples per supported group for the next stats
+     * interval of the station (adaptive sampling). Sampling is boosted for a
+     * few intervals after a node of the link starts or stops moving, and
+     * reduced while the predicted SNR is stable and the prediction error low.
+     *
+     * \param station the TARA wifi remote station
+     * \returns the number of samples per supported group
+     */
+    uint32_t GetSamplingBudget(TARAWifiRemoteStation* station);
+
     Time m_updateStats;            //!< How frequent do we calculate the stats.
     Time m_legacyUpdateStats;      //!< How frequent do we calculate the stats for legacy
                                    //!< MinstrelWifiManager.
+    bool m_batchedStats;           //!< If the stats are updated by a periodic event.
+    EventId m_statsEvent;          //!< Periodic update of the stats (\see UpdateDueStats).
     uint8_t m_lookAroundRate;      //!< The % to try other rates than our current rate.
     uint8_t m_ewmaLevel;           //!< Exponential weighted moving average level (or coefficient).
     uint8_t m_nSampleCol;          //!< Number of sample columns.
@@ -701,27 +1294,81 @@ class TARAWifiManager : public WifiRemoteStationManager
     bool m_useLatestAmendmentOnly; //!< Flag if only the latest supported amendment by both peers
                                    //!< should be used.
     bool m_printStats;             //!< If statistics table should be printed.
+    bool m_predictionBlending;     //!< If the TARA rate is weighted by the prediction confidence.
+    bool m_adaptiveSampling;       //!< If the sampling budget follows the TARA prediction.
+    bool m_predictiveRetry;        //!< If the retry chain follows the predicted trajectory.
+    Time m_retryLookahead;         //!< How far ahead the retry chain is predicted.
+    Time m_widthLookahead;         //!< How far ahead wider channels must be sustained.
+    bool m_powerControl;           //!< If the power of the data frames follows the prediction.
+    double m_powerMargin;          //!< Margin above the minimum SNR of the rate (dB).
+    uint8_t m_maxPowerLevel;       //!< Highest power level of the PHY.
+    double m_powerStep;            //!< Power difference between two levels (dB).
 
     MinstrelMcsGroups m_minstrelGroups; //!< Global array for groups information.
+    // To accurately account for TX times, we separate the TX time of the first
+    // MPDU in an A-MPDU from the rest of the MPDUs.
+    TxTime m_ratesTxTimeTable;          //!< rates transmit time table
+    TxTime m_ratesFirstMpduTxTimeTable; //!< rates first MPDU transmit time table
+    std::vector<double> m_ratesPerfectTxTime; //!< first MPDU transmit time of the rates (seconds),
+                                              //!< laid out as the statistics arrays
+    std::vector<double> m_sizeClassFirstTxTime; //!< First MPDU transmit time of the rates for
+                                                //!< each MPDU size class (seconds), one array
+                                                //!< laid out as the statistics arrays per class
+    std::vector<double> m_sizeClassTxTime;      //!< Transmit time of the next MPDUs, idem
+
+    std::vector<uint8_t> m_retryCountCache; //!< Retry counts by rate and A-MPDU length, 0 if
+                                            //!< not computed yet (\see GetRetryCount)
+
+    SampleRate m_sampleTable; //!< Sample table shared by all the HT stations (built on first use).
 
     Ptr<MinstrelWifiManager> m_legacyManager; //!< Pointer to an instance of MinstrelWifiManager.
                                               //!< Used when 802.11n/ac/ax not supported.
 
     Ptr<UniformRandomVariable> m_uniformRandomVariable; //!< Provides uniform random variables.
+
+    TARAStationPool* m_stationPool; //!< Pool of the remote stations and their statistics
+    std::unique_ptr<TARAStatsRecorder> m_statsRecorder; //!< Binary file where the statistics
+                                                        //!< tables of all the stations are
+                                                        //!< recorded (opened on use)
+    uint32_t m_traceEvents;                  //!< Size of the tracepoint ring (events).
+    std::vector<TARATraceEvent> m_traceRing; //!< Last rate-control decisions, \see Tracepoint
+    uint64_t m_traceCount;                   //!< Number of events recorded so far.
     
     /**
-     * A vector of <snr, WifiTxVector> pair holding the minimum SNR for the
-     * WifiTxVector
+     * Dense table of minimum SNRs, indexed by \see GetSnrThresholdIndex
      */
-    typedef std::vector<std::pair<double, WifiTxVector>> Thresholds;
-
-    double m_ber;            //!< The maximum Bit Error Rate acceptable at any transmission mode
-    Thresholds m_thresholds; //!< List of WifiTxVector and the minimum SNR pair
-
-    uint16_t m_TARARate;           //!< The TARA Algorithm current MCS prediction (MCS id)
-    double m_TARASnr;           //!< The TARA Algorithm current SNR prediction (dB)
+    typedef std::array<double, SNR_TABLE_SIZE> SnrThresholdTable;
+
+    double m_ber; //!< The maximum Bit Error Rate acceptable at any transmission mode
+    bool m_snrBiasCorrection;          //!< If the SNR prediction is corrected by its bias.
+    double m_snrBiasProcessNoise;      //!< Variance of the change of the SNR bias (dB^2).
+    double m_snrBiasMeasurementNoise;  //!< Variance of the reported SNR (dB^2).
+    std::string m_snrCacheDirectory; //!< Directory of the SNR threshold cache files
+    SnrThresholdTable m_snrThresholds;        //!< Minimum SNR of HT, VHT and HE modes
+    std::vector<double> m_legacySnrThresholds; //!< Minimum SNR of non-HT modes (by mode UID)
+    std::vector<double> m_groupSnrThresholds; //!< Minimum SNR of the rates of each group in a
+                                              //!< 20 MHz channel, sorted by increasing SNR
+                                              //!< (m_numRates slots per group)
+    std::vector<uint8_t> m_groupSnrRates;     //!< Rate ID of each entry of m_groupSnrThresholds
+    std::vector<uint8_t> m_groupSnrCounts;    //!< Number of entries of each group
+    std::vector<double> m_rateSnrThresholds;  //!< Minimum SNR of each rate in a 20 MHz channel
+                                              //!< (dB), by global index
+
+    double m_TARASnr; //!< The TARA Algorithm SNR prediction of peers without trajectory (dB)
+    TARAPeers m_peers; //!< Link state of each peer: trajectories, sampling airtime and MPDU
+                       //!< sizes (one entry, created by the first of them to be set)
+    Callback<double, double> m_snrModel; //!< SNR (dB) of a link from its length (m)
+    Mac48Address m_lastMpduPeer;     //!< Receiver of the last MPDU counted by NotifyMpduSize.
+    TARAMpduSizes* m_lastMpduSizes;  //!< Size classes of m_lastMpduPeer (nullptr if none).
 
     TracedValue<uint64_t> m_currentRate; //!< Trace rate changes
+    TracedCallback<Mac48Address, uint32_t, uint32_t>
+        m_retryStatsTrace; //!< Trace the retry statistics of the remote stations
+    TracedCallback<const TARARateDecision&>
+        m_rateDecisionTrace; //!< Trace the provenance of the rate decisions
+    TracedCallback<double, double, Mac48Address>
+        m_powerChangeTrace; //!< Trace the power changes of the data frames (dBm)
+    std::array<uint64_t, TARA_REASON_COUNT> m_decisionCounts; //!< Rate decisions by reason
 };
 
 } // namespace ns3
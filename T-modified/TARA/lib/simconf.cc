@@ -29,6 +29,9 @@ namespace ns3
 {
   NS_LOG_COMPONENT_DEFINE("simconf");
 
+  // Transmit power levels of the PHYs with power control: 0 to 20 dBm, in 1 dB steps
+  static const uint8_t TX_POWER_LEVELS = 21;
+
 //Debugging purposes
 uint64_t txPacketsFAPtoFGW = 0;
 uint64_t rxPacketsFGWfromFAP = 0;
@@ -38,6 +41,7 @@ uint64_t rxPacketsBKHfromFGW = 0;
 
 uint64_t txPacketsInterferer = 0;
 uint64_t totaltxPackets =0;
+uint64_t nackedMpdus = 0;
 double currentSnrBkh = 0.0;
 
 //Sink
@@ -95,6 +99,11 @@ void CountTxInterference(std::string context, Ptr<const Packet> packet) {
     txPacketsInterferer++;
 }
 
+// MPDUs not acknowledged by their receiver, e.g. the failed MPDUs of the A-MPDUs
+void CountNAckedMpdu(std::string context, Ptr<const WifiMpdu> mpdu) {
+    nackedMpdus++;
+}
+
 
 void
 SnifferRxCallback(Ptr<const Packet> packet,
@@ -347,6 +356,7 @@ void PrintDeviceSummary()
         Config::ConnectFailSafe("/NodeList/2/DeviceList/0/$ns3::WifiNetDevice/Mac/MacTx", MakeCallback(&CountTxInterference));
 
         Config:: ConnectFailSafe("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Mac/MacTx", MakeCallback(&CountTotalTx));
+        Config::ConnectFailSafe("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Mac/NAckedMpdu", MakeCallback(&CountNAckedMpdu));
         //Config:: Connect("/NodeList/0/DeviceList/0/$ns3::WifiNetDevice/Phy/MonitorSnifferRx",MakeCallback(&SnifferRxCallback));
     Ptr<WifiNetDevice> bkhDevice = DynamicCast<WifiNetDevice>(NodeContainer::GetGlobal().Get(0)->GetDevice(0));
     bkhDevice->GetPhy()->TraceConnectWithoutContext("MonitorSnifferRx", MakeCallback(&SnifferRxCallback));
@@ -356,7 +366,7 @@ void PrintDeviceSummary()
   }
 
   WifiHelper
-  configWifi (std::string raAlg)
+  configWifi (std::string raAlg, bool blending, bool snrBias, bool powerControl)
   {
     WifiHelper wifi;
     wifi.SetStandard (WIFI_STANDARD_80211n);
@@ -366,23 +376,37 @@ void PrintDeviceSummary()
     else if (raAlg == "id")
       wifi.SetRemoteStationManager ("ns3::IdealWifiManager");
     else if (raAlg == "lupo")
-        wifi.SetRemoteStationManager ("ns3::TARAWifiManager");
+        wifi.SetRemoteStationManager ("ns3::TARAWifiManager",
+                                      "PredictionBlending", BooleanValue (blending),
+                                      "SnrBiasCorrection", BooleanValue (snrBias),
+                                      "PowerControl", BooleanValue (powerControl),
+                                      // Control frames at the maximum power
+                                      "DefaultTxPowerLevel",
+                                      UintegerValue (powerControl ? TX_POWER_LEVELS - 1 : 0));
 
     return wifi;
   }
 
   YansWifiPhyHelper
-  configWifiPhy (int freqMHz)
+  configWifiPhy (int freqMHz, bool powerControl, int channelWidth)
   {
     NS_LOG_INFO ("INFO: Configuring WifiPhy...");
     YansWifiPhyHelper wifiPhy;
     YansWifiChannelHelper wifiChannel;
-    wifiPhy.Set ("Frequency", UintegerValue (freqMHz));
-    wifiPhy.Set ("ChannelWidth", UintegerValue (20));
+    // The Frequency and ChannelWidth attributes of the PHY can only be read: set
+    // the 20 MHz channel of freqMHz (36 at 5180 MHz, 48 at 5240 MHz), or the
+    // 40 MHz channel that contains it (38 and 46), with its primary channel first
+    int channel = (freqMHz - 5000) / 5;
+    if (channelWidth == 40)
+      channel += (channel - 36) % 8 == 0 ? 2 : -2;
+    wifiPhy.Set ("ChannelSettings",
+                 StringValue ("{" + std::to_string (channel) + ", " + std::to_string (channelWidth) +
+                              ", BAND_5GHZ, 0}"));
     wifiPhy.Set ("RxGain", DoubleValue (0)); // dBi
     wifiPhy.Set ("TxGain", DoubleValue (0)); // dBi
-    wifiPhy.Set ("TxPowerStart", DoubleValue (20)); // dBm = 100mW
-    wifiPhy.Set ("TxPowerEnd", DoubleValue (20)); // dBm = 100mW
+    wifiPhy.Set ("TxPowerStart", DoubleValue (powerControl ? 0 : 20)); // dBm
+    wifiPhy.Set ("TxPowerEnd", DoubleValue (20)); // dBm = 100mW, as in PredictSNRAtDistance
+    wifiPhy.Set ("TxPowerLevels", UintegerValue (powerControl ? TX_POWER_LEVELS : 1));
     wifiPhy.SetErrorRateModel ("ns3::NistErrorRateModel");
     wifiChannel.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
     wifiChannel.AddPropagationLoss (
@@ -29,9 +29,9 @@ namespace ns3
 
   void configApps(Ipv4InterfaceContainer interfaces_1, Ipv4InterfaceContainer interfaces_2);
 
-  WifiHelper configWifi(std::string raAlg);
+  WifiHelper configWifi(std::string raAlg, bool blending, bool snrBias, bool powerControl);
 
-  YansWifiPhyHelper configWifiPhy(int freqMHz);
+  YansWifiPhyHelper configWifiPhy(int freqMHz, bool powerControl, int channelWidth);
 
   WifiMacHelper configWifiMac();
 
@@ -45,6 +45,7 @@ extern uint64_t rxPacketsBKHfromFGW;
 
 extern uint64_t txPacketsInterferer;
 extern uint64_t totaltxPackets;
+extern uint64_t nackedMpdus;
 extern double currentSnrBkh;
 
 //
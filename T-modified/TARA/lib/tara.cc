@@ -24,17 +24,30 @@
 #include "ns3/log.h"
 #include <ns3/node.h>
 #include <ns3/node-container.h>
+#include <ns3/node-list.h>
+#include <ns3/wifi-net-device.h>
 
 namespace ns3
 {
 
   NS_LOG_COMPONENT_DEFINE("tarafuncs");
 
+  // Rate managers of the links, resolved once by ConfigTARATargets and released
+  // by ResetTARATargets when the simulator is destroyed
+  static TARAPredictionTarget fgwToBkh, fapToFgw, fgwToFap;
+
+  static void
+  ResetTARATargets()
+  {
+    fgwToBkh = TARAPredictionTarget ();
+    fapToFgw = TARAPredictionTarget ();
+    fgwToFap = TARAPredictionTarget ();
+  }
+
   void
   taraAlg(struct NodeMovInfo fap)
   {
     NodeContainer c = NodeContainer::GetGlobal();
-    uint8_t new_interval = 30;
     struct NodeMovInfo backhaul, fgw;
 
     backhaul.current_pos = c.Get(0)->GetObject<MobilityModel>()->GetPosition();
@@ -47,21 +60,58 @@ namespace ns3
 
     fgw = CalcFGWmov(fgw); // !!!! assuming FGW is always the last ID of the container !!!!
 
-    //Predict Future SNR of each TARAstation
-    for (double tf = 0; tf < new_interval*1000; tf+=500)
-    {
-      double future_snr_2 = PredictSNR(tf, fgw, backhaul);
-      Simulator::Schedule(MilliSeconds(tf), &ConfigNewTARASnr, future_snr_2, "3", "0"); //fgw: Changed to 3 because of the assumption that FGW is always the last node
-                                                                                                  //and i added the interference
-      double future_snr_1 = PredictSNR(tf, fgw, fap);
-      Simulator::Schedule(MilliSeconds(tf), &ConfigNewTARASnr, future_snr_1, "1", "0"); //fap
-    }
+    //Hand the trajectories of each link to the rate managers, which predict the SNR when they need it
+    DeliverTARATrajectory(fgwToBkh, fgw, backhaul);
+    DeliverTARATrajectory(fapToFgw, fap, fgw);
+    DeliverTARATrajectory(fgwToFap, fgw, fap); //fgw, towards the fap
+  }
+
+  void
+  ConfigTARATargets()
+  {
+    NodeContainer c = NodeContainer::GetGlobal();
+    uint32_t fgw_id = c.GetN()-1; // !!!! assuming FGW is always the last ID of the container !!!!
+
+    // Peers of each link: BKH <-> FGW (device 0) and FAP <-> FGW (device 1)
+    Mac48Address bkh_address = Mac48Address::ConvertFrom(c.Get(0)->GetDevice(0)->GetAddress());
+    Mac48Address fap_address = Mac48Address::ConvertFrom(c.Get(1)->GetDevice(0)->GetAddress());
+    Mac48Address fgw_fap_address = Mac48Address::ConvertFrom(c.Get(fgw_id)->GetDevice(1)->GetAddress());
+
+    fgwToBkh = ResolveTARAPredictionTarget(fgw_id, 0, bkh_address);
+    fapToFgw = ResolveTARAPredictionTarget(1, 0, fgw_fap_address);
+    fgwToFap = ResolveTARAPredictionTarget(fgw_id, 1, fap_address);
+    Simulator::ScheduleDestroy (&ResetTARATargets);
+  }
+
+  TARAPredictionTarget
+  ResolveTARAPredictionTarget(uint32_t node_id, uint32_t device_id, Mac48Address peer)
+  {
+    TARAPredictionTarget target;
+    target.peer = peer;
+    Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice>(NodeList::GetNode(node_id)->GetDevice(device_id));
+    if (device)
+      target.manager = DynamicCast<TARAWifiManager>(device->GetRemoteStationManager());
+    // Other rate managers (--raAlg=min, id) do not take predictions
+    if (target.manager)
+      target.manager->SetSnrModel(MakeCallback(&PredictSNRAtDistance));
+    return target;
   }
 
-  void ConfigNewTARASnr(double new_snr, std::string node_id, std::string device_id)
+  void
+  DeliverTARATrajectory(const TARAPredictionTarget& target, const struct NodeMovInfo& local, const struct NodeMovInfo& remote)
   {
-      std::string config_string = "/NodeList/" + node_id + "/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/$ns3::TARAWifiManager/TARASnr"; //changes tara-wifi-manager.cc
-      Config::Set(config_string, DoubleValue(new_snr));
+    if (target.manager)
+      target.manager->SetTrajectory(target.peer, ToTARAMotion(local), ToTARAMotion(remote));
+  }
+
+  TARAMotion ToTARAMotion(const struct NodeMovInfo& node)
+  {
+    TARAMotion motion;
+    motion.position = node.current_pos;
+    motion.velocity = node.velocity;
+    motion.start = Simulator::Now();
+    motion.duration = Seconds(node.flight_duration);
+    return motion;
   }
 
   struct NodeMovInfo CalcFGWmov(struct NodeMovInfo fgw)
@@ -111,12 +161,18 @@ namespace ns3
 
   double PredictSNR(double time, struct NodeMovInfo node1, struct NodeMovInfo node2)
   {
-    double noise_power = 3.16e-13;
-    double ch_frequency=5180000000;
-    int tx_power=20, tx_gain=0, rx_gain=0;
     double timeSeconds = time / 1000;
 
     double distance = CalculateDistance(CalcFuturePosition(node1, timeSeconds), CalcFuturePosition(node2, timeSeconds));
+    return PredictSNRAtDistance(distance);
+  }
+
+  double PredictSNRAtDistance(double distance)
+  {
+    double noise_power = 3.16e-13;
+    double ch_frequency=5180000000;
+    int tx_power=20, tx_gain=0, rx_gain=0; // maximum power of the PHYs: TARAWifiManager scales it down
+
     NS_ABORT_MSG_IF(distance == 0, "ERROR: Distance between nodes cannot be 0.");
 
     double snrval = 10*log10(receivedPower(CalcPathLossComponent(distance, ch_frequency), 
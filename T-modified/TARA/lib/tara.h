@@ -18,6 +18,8 @@
 #include "ns3/core-module.h"
 #include <ns3/mobility-module.h>
 #include <ns3/vector.h>
+#include <ns3/mac48-address.h>
+#include <ns3/tara-wifi-manager.h>
 
 namespace ns3
 {
@@ -30,11 +32,23 @@ struct NodeMovInfo
   double flight_duration = 0;
 };
 
+// Rate manager of a device and the peer of its link, to which the trajectory
+// predictions of the link are delivered (no manager if it is not TARA)
+struct TARAPredictionTarget
+{
+  Ptr<TARAWifiManager> manager;
+  Mac48Address peer;
+};
+
 void taraAlg(struct NodeMovInfo fap);
 struct NodeMovInfo CalcFGWmov(struct NodeMovInfo fgw);
 Vector CalcFuturePosition(struct NodeMovInfo node, double t);
 double PredictSNR(double time, struct NodeMovInfo node1, struct NodeMovInfo node2);
-void ConfigNewTARASnr(double new_snr, std::string node_id, std::string device_id);
+double PredictSNRAtDistance(double distance);
+void ConfigTARATargets();
+TARAPredictionTarget ResolveTARAPredictionTarget(uint32_t node_id, uint32_t device_id, Mac48Address peer);
+void DeliverTARATrajectory(const TARAPredictionTarget& target, const struct NodeMovInfo& local, const struct NodeMovInfo& remote);
+TARAMotion ToTARAMotion(const struct NodeMovInfo& node);
 void SetNodeMovement(Ptr<MobilityModel> mobmodel, Vector velocity);
 void StopNode(Ptr<MobilityModel> mob_model);
 Vector GeometricCenter(std::vector<Vector> positions);
@@ -45,11 +45,23 @@ main (int argc, char **argv)
   configLogs();
   double simSeed=10;
   std::string raAlg = "tara";
+  bool blending = false;
+  bool snrBias = false;
+  bool powerControl = false;
+  int channelWidth = 20;
 
   CommandLine cmd; 
   cmd.AddValue ("simSeed", "random generator seed", simSeed);
   cmd.AddValue ("raAlg", "tara, min, id", raAlg);
+  cmd.AddValue ("blending", "weight the TARA rate by the prediction confidence (lupo)", blending);
+  cmd.AddValue ("snrBias", "correct the SNR prediction by the SNR reported in the ACKs (lupo)", snrBias);
+  cmd.AddValue ("powerControl", "lowest transmit power sustaining the predicted rate (lupo)", powerControl);
+  cmd.AddValue ("channelWidth", "widest channel of the links (MHz): 20 or 40", channelWidth);
   cmd.Parse (argc, argv);  
+  NS_ABORT_MSG_IF (blending && raAlg != "lupo", "--blending needs --raAlg=lupo");
+  NS_ABORT_MSG_IF (snrBias && raAlg != "lupo", "--snrBias needs --raAlg=lupo");
+  NS_ABORT_MSG_IF (powerControl && raAlg != "lupo", "--powerControl needs --raAlg=lupo");
+  NS_ABORT_MSG_IF (channelWidth != 20 && channelWidth != 40, "802.11n channels are 20 or 40 MHz wide");
 
   RngSeedManager::SetSeed (simSeed);
   RngSeedManager::SetRun (10);
@@ -59,12 +71,12 @@ main (int argc, char **argv)
 
   configNodeMobility(); //aqui
  
-  WifiHelper wifi = configWifi (raAlg);
+  WifiHelper wifi = configWifi (raAlg, blending, snrBias, powerControl);
   
   YansWifiPhyHelper wifiPhy1, wifiPhy2;
   
-  wifiPhy1 = configWifiPhy(5180);
-  wifiPhy2 = configWifiPhy(5240);
+  wifiPhy1 = configWifiPhy(5180, powerControl, channelWidth);
+  wifiPhy2 = configWifiPhy(5240, powerControl, channelWidth);
 
   WifiMacHelper wifiMac = configWifiMac ();
 
@@ -92,6 +104,7 @@ main (int argc, char **argv)
   interfaces_2 = ipv4_2.Assign (devices2);
 
   configApps (interfaces_1, interfaces_2);
+  ConfigTARATargets ();
   configMisc ();
 
   Monitor(true);
@@ -114,6 +127,7 @@ main (int argc, char **argv)
     summary << "  TX: " << txPacketsInterferer << "\n";
 
     summary <<"Total Received" << totaltxPackets << "\n";
+    summary << "NAcked MPDUs: " << nackedMpdus << "\n";
     summary << "Actual SNR at BKH: " << currentSnrBkh << "\n";
 
     summary.close();
@@ -0,0 +1,83 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Helpers shared by the decoders of the binary files written by
+// TARAWifiManager: the file header check and the formatting of the station
+// addresses of the records.
+
+#ifndef TARA_DECODE_H
+#define TARA_DECODE_H
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+inline std::string
+FormatAddress(const uint8_t* address)
+{
+  std::ostringstream os;
+  os << std::hex << std::setfill('0');
+  for (uint8_t i = 0; i < 6; i++)
+    {
+      os << (i ? ":" : "") << std::setw(2) << +address[i];
+    }
+  return os.str();
+}
+
+/**
+ * Open a binary file of TARAWifiManager and read its header, which must have
+ * the given magic and version and records of type Record. On error, the reason
+ * is printed on the standard error.
+ *
+ * \param input the file name
+ * \param magic the file magic
+ * \param version the version of the file layout
+ * \param kind the kind of file, for the messages (e.g. "statistics")
+ * \param unit the name of a record, for the messages (e.g. "record")
+ * \param in the stream, left after the header
+ * \param header the header read
+ * \returns true if the file was opened and its header is valid
+ */
+template <class Record, class Header>
+inline bool
+OpenTARAFile(const std::string& input, const char (&magic)[8], uint32_t version,
+             const std::string& kind, const std::string& unit, std::ifstream& in, Header& header)
+{
+  in.open(input, std::ios::in | std::ios::binary);
+  if (!in)
+    {
+      std::cerr << "Cannot open " << input << std::endl;
+      return false;
+    }
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+    {
+      std::cerr << input << " is not a TARA " << kind << " file" << std::endl;
+      return false;
+    }
+  if (header.version != version || header.recordSize != sizeof(Record))
+    {
+      std::cerr << input << ": unsupported version " << header.version << " (" << unit
+                << " size " << header.recordSize << ")" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+#endif /* TARA_DECODE_H */
@@ -0,0 +1,147 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Decoder of the binary statistics files written by TARAWifiManager when the
+// PrintStats attribute is set (minstrel-ht-stats-<address>.bin). Prints the
+// records either as the Minstrel-HT text tables or as CSV.
+
+#include <ns3/core-module.h>
+#include <ns3/tara-wifi-manager.h>
+
+#include "tara-decode.h"
+
+using namespace ns3;
+
+static void
+PrintTableHeader(std::ostream& os, const TARAStatsRecord& r)
+{
+  os << "Station " << FormatAddress(r.station) << " at " << r.time / 1e9 << "s\n"
+     << "               best   ____________rate__________    ________statistics________    "
+        "________last_______    ______sum-of________\n"
+     << " mode guard #  rate  [name   idx airtime  max_tp]  [avg(tp) avg(prob) sd(prob)]  "
+        "[prob.|retry|suc|att]  [#success | #attempts]\n";
+}
+
+static void
+PrintTableTrailer(std::ostream& os, const TARAStatsRecord& r)
+{
+  os << "\nTotal packet count::    ideal " << r.idealPackets << "              lookaround "
+     << r.lookaroundPackets << "\n";
+  os << "Average # of aggregated frames per A-MPDU: " << r.avgAmpduLen << "\n\n";
+}
+
+static void
+PrintTextRecord(std::ostream& os, const TARAStatsRecord& r)
+{
+  os << static_cast<McsGroupType>(r.type) << " " << r.chWidth << "   " << r.gi << "  "
+     << +r.streams << "   ";
+  os << (r.flags & TARA_STATS_MAX_TP ? 'A' : ' ') << (r.flags & TARA_STATS_MAX_TP2 ? 'B' : ' ')
+     << (r.flags & TARA_STATS_MAX_PROB ? 'P' : ' ');
+  if (r.type == WIFI_MINSTREL_GROUP_HT)
+    {
+      os << std::setw(4) << "   MCS" << (r.streams - 1) * 8 + r.rate;
+    }
+  else
+    {
+      os << std::setw(7) << "   MCS" << +r.rate << "/" << +r.streams;
+    }
+  os << "  " << std::setw(3) << r.index << "  " << std::setw(6) << r.airtime << "  "
+     << std::setw(7) << r.maxThroughput / 100 << "   " << std::setw(7) << r.throughput / 100
+     << "   " << std::setw(7) << r.ewmaProb << "  " << std::setw(7) << r.ewmsdProb << "  "
+     << std::setw(7) << r.prob << "  " << std::setw(2) << +r.retryCount << "   " << std::setw(3)
+     << r.successes << "  " << std::setw(3) << r.attempts << "   " << std::setw(9)
+     << r.successHist << "   " << std::setw(9) << r.attemptHist << "\n";
+}
+
+static void
+PrintCsvRecord(std::ostream& os, const TARAStatsRecord& r)
+{
+  os << r.time << "," << FormatAddress(r.station) << "," << +r.group << "," << +r.rate << ","
+     << r.index << "," << static_cast<McsGroupType>(r.type) << "," << +r.streams << "," << r.gi
+     << "," << r.chWidth << "," << (r.flags & TARA_STATS_MAX_TP ? "A" : "")
+     << (r.flags & TARA_STATS_MAX_TP2 ? "B" : "") << (r.flags & TARA_STATS_MAX_PROB ? "P" : "")
+     << "," << +r.retryCount << "," << r.airtime << "," << r.maxThroughput << ","
+     << r.throughput << "," << r.ewmaProb << "," << r.ewmsdProb << "," << r.prob << ","
+     << r.successes << "," << r.attempts << "," << r.successHist << "," << r.attemptHist << ","
+     << r.idealPackets << "," << r.lookaroundPackets << "," << r.avgAmpduLen << "\n";
+}
+
+int
+main(int argc, char** argv)
+{
+  std::string input;
+  std::string format = "text";
+
+  CommandLine cmd;
+  cmd.AddValue("input", "statistics file written by TARAWifiManager", input);
+  cmd.AddValue("format", "output format: text or csv", format);
+  cmd.Parse(argc, argv);
+
+  if (format != "text" && format != "csv")
+    {
+      std::cerr << "Unknown format " << format << std::endl;
+      return 1;
+    }
+  std::ifstream in;
+  TARAStatsFileHeader header;
+  if (!OpenTARAFile<TARAStatsRecord>(input, TARA_STATS_MAGIC, TARA_STATS_VERSION, "statistics",
+                                     "record", in, header))
+    {
+      return 1;
+    }
+
+  if (format == "csv")
+    {
+      std::cout << "time_ns,station,group,rate,idx,type,streams,gi,width,best,retry,airtime_us,"
+                   "max_tp,tp,ewma_prob,ewmsd_prob,prob,suc,att,success_hist,attempt_hist,"
+                   "ideal,lookaround,avg_ampdu_len\n";
+    }
+
+  // The records of a table are consecutive and share the time and the station
+  TARAStatsRecord record;
+  TARAStatsRecord last;
+  bool haveTable = false;
+  for (uint64_t n = 0; n < header.nRecords; n++)
+    {
+      if (!in.read(reinterpret_cast<char*>(&record), sizeof(record)))
+        {
+          std::cerr << input << ": truncated after " << n << " records" << std::endl;
+          break;
+        }
+      if (format == "csv")
+        {
+          PrintCsvRecord(std::cout, record);
+          continue;
+        }
+      if (!haveTable || record.time != last.time ||
+          std::memcmp(record.station, last.station, sizeof(record.station)) != 0)
+        {
+          if (haveTable)
+            {
+              PrintTableTrailer(std::cout, last);
+            }
+          PrintTableHeader(std::cout, record);
+        }
+      PrintTextRecord(std::cout, record);
+      last = record;
+      haveTable = true;
+    }
+  if (haveTable)
+    {
+      PrintTableTrailer(std::cout, last);
+    }
+  return 0;
+}
@@ -0,0 +1,124 @@
+//Copyright (C) 2023, INESC TEC
+//This file is part of TARA https://gitlab.inesctec.pt/pub/ctm-win/tara.
+//
+//TARA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//TARA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with TARA.  If not, see <http://www.gnu.org/licenses/>.
+
+// Decoder of the tracepoint files written by TARAWifiManager::DumpTracepoints:
+// the last rate-control decisions of the manager, oldest first, as text or CSV.
+
+#include <ns3/core-module.h>
+#include <ns3/tara-wifi-manager.h>
+
+#include "tara-decode.h"
+
+using namespace ns3;
+
+static const char*
+GetEventName(uint8_t type)
+{
+  switch (type)
+    {
+    case TARA_TRACE_TARA_RATE:
+      return "tara-rate";
+    case TARA_TRACE_STATS_UPDATE:
+      return "stats-update";
+    case TARA_TRACE_SAMPLE:
+      return "sample";
+    case TARA_TRACE_RETRY:
+      return "retry";
+    default:
+      return "unknown";
+    }
+}
+
+static void
+PrintTextEvent(std::ostream& os, const TARATraceEvent& e)
+{
+  os << std::fixed << std::setprecision(9) << e.time / 1e9 << "s " << FormatAddress(e.station)
+     << " " << std::left << std::setw(12) << GetEventName(e.type) << std::right << " "
+     << std::setw(4) << e.oldRate << " -> " << std::setw(4) << e.newRate;
+  switch (e.type)
+    {
+    case TARA_TRACE_TARA_RATE:
+      os << "  snr=" << std::setprecision(2) << e.snr << "dB";
+      break;
+    case TARA_TRACE_STATS_UPDATE:
+      os << "  maxTp2=" << e.value[0] << " maxProb=" << e.value[1];
+      break;
+    case TARA_TRACE_SAMPLE:
+      os << "  sampleTries=" << e.value[0];
+      break;
+    case TARA_TRACE_RETRY:
+      os << "  longRetry=" << e.value[0] << (e.value[1] ? " sampling" : "");
+      break;
+    }
+  os << "\n";
+}
+
+static void
+PrintCsvEvent(std::ostream& os, const TARATraceEvent& e)
+{
+  os << e.time << "," << FormatAddress(e.station) << "," << GetEventName(e.type) << ","
+     << e.oldRate << "," << e.newRate << "," << e.snr << "," << e.value[0] << "," << e.value[1]
+     << "\n";
+}
+
+int
+main(int argc, char** argv)
+{
+  std::string input;
+  std::string format = "text";
+
+  CommandLine cmd;
+  cmd.AddValue("input", "tracepoint file written by TARAWifiManager::DumpTracepoints", input);
+  cmd.AddValue("format", "output format: text or csv", format);
+  cmd.Parse(argc, argv);
+
+  if (format != "text" && format != "csv")
+    {
+      std::cerr << "Unknown format " << format << std::endl;
+      return 1;
+    }
+  std::ifstream in;
+  TARATraceFileHeader header;
+  if (!OpenTARAFile<TARATraceEvent>(input, TARA_TRACE_MAGIC, TARA_TRACE_VERSION, "tracepoint",
+                                    "event", in, header))
+    {
+      return 1;
+    }
+
+  if (format == "csv")
+    {
+      std::cout << "time_ns,station,event,old_rate,new_rate,snr_db,value0,value1\n";
+    }
+
+  TARATraceEvent event;
+  for (uint64_t n = 0; n < header.nEvents; n++)
+    {
+      if (!in.read(reinterpret_cast<char*>(&event), sizeof(event)))
+        {
+          std::cerr << input << ": truncated after " << n << " events" << std::endl;
+          break;
+        }
+      if (format == "csv")
+        {
+          PrintCsvEvent(std::cout, event);
+        }
+      else
+        {
+          PrintTextEvent(std::cout, event);
+        }
+    }
+  return 0;
+}